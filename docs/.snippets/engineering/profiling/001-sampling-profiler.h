@@ -0,0 +1,245 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// An in-process CPU profiler. A |SIGPROF| timer interrupts the thread which
+// is using the CPU |frequency_hz| times per CPU second. The signal handler
+// only copies the stack into a preallocated buffer, without locks or
+// allocation. A background thread aggregates the stacks and writes them in
+// the legacy gperftools CPU profile format, which pprof reads:
+//
+//   pprof --http=: path/to/binary path/to/profile
+//
+// x86-64 Linux only. The stacks are walked with the frame pointers: build
+// with -fno-omit-frame-pointer, otherwise they stop at the first function
+// which omits them. Only one profiler can run per process. A profiler can be
+// started again after |Stop()|, for a new profile.
+struct SamplingProfilerOptions {
+  int frequency_hz = 100;
+  std::string profile_path;
+  // Also write the profile so far every |write_interval|, if not zero.
+  absl::Duration write_interval = absl::ZeroDuration();
+};
+
+class SamplingProfiler : public Service {
+ public:
+  explicit SamplingProfiler(SamplingProfilerOptions options)
+      : options_(std::move(options)) {}
+  ~SamplingProfiler() override { Stop().IgnoreError(); }
+
+  Status Start() override {
+    if (options_.profile_path.empty()) {
+      return absl::InvalidArgumentError("profile_path is required");
+    }
+    if (options_.frequency_hz <= 0) {
+      return absl::InvalidArgumentError("frequency_hz must be positive");
+    }
+    if (background_thread_ != nullptr) {
+      return absl::FailedPreconditionError("the profiler is already running");
+    }
+    // Nothing samples into |this| until |instance_| points to it, and |Stop()|
+    // drained every slot of the previous run.
+    stopping_notification_ = std::make_unique<absl::Notification>();
+    next_slot_.store(0);
+    dropped_samples_.store(0);
+    {
+      absl::MutexLock lock(&mutex_);
+      stacks_.clear();
+    }
+    SamplingProfiler* expected = nullptr;
+    if (!instance_.compare_exchange_strong(expected, this)) {
+      return absl::FailedPreconditionError("a profiler is already running");
+    }
+    // The handler stays installed after |Stop()|: a |SIGPROF| still pending
+    // then must not terminate the process, which the default action does.
+    static const bool handler_installed = [] {
+      struct sigaction action = {};
+      action.sa_sigaction = &SamplingProfiler::SignalHandler;
+      action.sa_flags = SA_SIGINFO | SA_RESTART;
+      sigemptyset(&action.sa_mask);
+      return ::sigaction(SIGPROF, &action, nullptr) == 0;
+    }();
+    if (!handler_installed) {
+      instance_.store(nullptr);
+      return absl::InternalError("cannot install the SIGPROF handler");
+    }
+    background_thread_ = std::make_unique<std::thread>(
+        &SamplingProfiler::BackgroundThreadEntryPoint, this);
+    SetTimer(absl::Seconds(1) / options_.frequency_hz);
+    return Status::OK();
+  }
+
+  // Stops sampling and writes the profile.
+  Status Stop() override {
+    if (background_thread_ == nullptr) {
+      return Status::OK();
+    }
+    SetTimer(absl::ZeroDuration());
+    instance_.store(nullptr);
+    // A handler which saw |this| before the store may still be running.
+    while (handlers_running_.load() > 0) {
+      std::this_thread::yield();
+    }
+    stopping_notification_->Notify();
+    background_thread_->join();
+    background_thread_.reset();
+    return WriteProfile(options_.profile_path);
+  }
+
+  // Writes the profile so far, e.g. from a debug HTTP handler. The file is
+  // replaced atomically.
+  Status WriteProfile(const std::string& path) {
+    absl::MutexLock lock(&mutex_);
+    DrainSamples();
+    const uintptr_t period_us =
+        absl::ToInt64Microseconds(absl::Seconds(1)) / options_.frequency_hz;
+    std::vector<uintptr_t> words = {0, 3, 0, period_us, 0};  // Header.
+    for (const auto& [stack, count] : stacks_) {
+      words.push_back(count);
+      words.push_back(stack.size());
+      for (void* pc : stack) {
+        words.push_back(reinterpret_cast<uintptr_t>(pc));
+      }
+    }
+    words.insert(words.end(), {0, 1, 0});  // Trailer.
+
+    // pprof maps the addresses to binaries and symbols with the memory map.
+    std::ifstream maps("/proc/self/maps");
+    const std::string memory_map((std::istreambuf_iterator<char>(maps)),
+                                 std::istreambuf_iterator<char>());
+
+    const std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(words.data()),
+              words.size() * sizeof(words[0]));
+    out << memory_map;
+    out.close();
+    if (!out || ::rename(temp_path.c_str(), path.c_str()) != 0) {
+      return IOError(path, errno);
+    }
+    return Status::OK();
+  }
+
+  // Samples the buffer had no room for, should stay 0.
+  int64_t dropped_samples() const { return dropped_samples_.load(); }
+
+ private:
+  static constexpr int kMaxDepth = 64;
+  static constexpr int kBufferSize = 1024;  // Power of two.
+  static constexpr absl::Duration kDrainInterval = absl::Milliseconds(100);
+  // The largest gap between two frame pointers which is still followed.
+  static constexpr uintptr_t kMaxFrameSize = 64 << 10;
+
+  enum SlotState { kEmpty, kWriting, kFull };
+
+  struct Slot {
+    std::atomic<int> state{kEmpty};
+    int depth = 0;
+    void* pcs[kMaxDepth];
+  };
+
+  static void SetTimer(absl::Duration interval) {
+    const timeval tv = absl::ToTimeval(interval);
+    const itimerval timer = {.it_interval = tv, .it_value = tv};
+    ::setitimer(ITIMER_PROF, &timer, nullptr);
+  }
+
+  // Async-signal-safe: atomics and plain loads and stores only.
+  static void SignalHandler(int /*signal*/, siginfo_t* /*info*/,
+                            void* ucontext) {
+    const int saved_errno = errno;
+    handlers_running_.fetch_add(1);
+    if (SamplingProfiler* self = instance_.load()) {
+      self->RecordSample(static_cast<const ucontext_t*>(ucontext));
+    }
+    handlers_running_.fetch_sub(1);
+    errno = saved_errno;
+  }
+
+  void RecordSample(const ucontext_t* uc) {
+    // Slots are taken in turn, and the background thread empties them long
+    // before the index wraps around, unless it falls behind.
+    const uint64_t ticket = next_slot_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[ticket & (kBufferSize - 1)];
+    int expected = kEmpty;
+    if (!slot.state.compare_exchange_strong(expected, kWriting,
+                                            std::memory_order_acquire)) {
+      dropped_samples_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    slot.depth = WalkStack(uc, slot.pcs);
+    slot.state.store(kFull, std::memory_order_release);
+  }
+
+  // The first address is where the thread was interrupted, the others are
+  // return addresses. A frame pointer is only followed if it points above
+  // the previous frame and not too far from it, so that a register which is
+  // not a frame pointer does not send the handler into unmapped memory.
+  ABSL_ATTRIBUTE_NO_SANITIZE_ADDRESS
+  static int WalkStack(const ucontext_t* uc, void** pcs) {
+    const greg_t* regs = uc->uc_mcontext.gregs;
+    pcs[0] = reinterpret_cast<void*>(regs[REG_RIP]);
+    uintptr_t low = regs[REG_RSP];
+    uintptr_t fp = regs[REG_RBP];
+    int depth = 1;
+    while (depth < kMaxDepth && fp >= low && fp - low <= kMaxFrameSize &&
+           fp % sizeof(uintptr_t) == 0) {
+      const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+      if (frame[1] == 0) {
+        break;  // The outermost frame.
+      }
+      pcs[depth++] = reinterpret_cast<void*>(frame[1]);
+      low = fp + 2 * sizeof(uintptr_t);
+      fp = frame[0];
+    }
+    return depth;
+  }
+
+  void BackgroundThreadEntryPoint() {
+    absl::Time next_write = absl::Now() + options_.write_interval;
+    while (!stopping_notification_->WaitForNotificationWithTimeout(
+        kDrainInterval)) {
+      {
+        absl::MutexLock lock(&mutex_);
+        DrainSamples();
+      }
+      if (options_.write_interval > absl::ZeroDuration() &&
+          absl::Now() >= next_write) {
+        WriteProfile(options_.profile_path).IgnoreError();
+        next_write += options_.write_interval;
+      }
+    }
+  }
+
+  void DrainSamples() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    for (Slot& slot : slots_) {
+      if (slot.state.load(std::memory_order_acquire) == kFull) {
+        ++stacks_[std::vector<void*>(slot.pcs, slot.pcs + slot.depth)];
+        slot.state.store(kEmpty, std::memory_order_release);
+      }
+    }
+  }
+
+  static std::atomic<SamplingProfiler*> instance_;
+  static std::atomic<int> handlers_running_;
+
+  const SamplingProfilerOptions options_;
+  std::unique_ptr<std::thread> background_thread_;
+  // One per run: a notification cannot be reset.
+  std::unique_ptr<absl::Notification> stopping_notification_;
+
+  Slot slots_[kBufferSize];
+  std::atomic<uint64_t> next_slot_{0};
+  std::atomic<int64_t> dropped_samples_{0};
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::vector<void*>, int64_t> stacks_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+std::atomic<SamplingProfiler*> SamplingProfiler::instance_{nullptr};
+std::atomic<int> SamplingProfiler::handlers_running_{0};
+// --8<-- [end:code]
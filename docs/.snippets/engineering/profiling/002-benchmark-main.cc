@@ -0,0 +1,38 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Replaces the main() of @google_benchmark//:benchmark_main. With
+// --cpu_profile=<path>, the benchmarks run under the sampling profiler, as a
+// server would with its other services.
+int main(int argc, char** argv) {
+  std::unique_ptr<SamplingProfiler> profiler;
+  int kept = 1;
+  for (int i = 1; i < argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (absl::ConsumePrefix(&arg, "--cpu_profile=")) {
+      profiler = std::make_unique<SamplingProfiler>(
+          SamplingProfilerOptions{.profile_path = std::string(arg)});
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  if (profiler != nullptr) {
+    CHECK_OK(profiler->Start());
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  if (profiler != nullptr) {
+    CHECK_OK(profiler->Stop());
+    std::cerr << "Dropped samples: " << profiler->dropped_samples() << "\n";
+  }
+  return 0;
+}
+// --8<-- [end:code]
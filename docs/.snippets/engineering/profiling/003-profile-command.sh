@@ -0,0 +1,23 @@
+# SPDX-FileCopyrightText: 2021 Shuai Zhang
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# --8<-- [start:code]
+# The stacks need the frame pointers, in the baseline too so that only the
+# profiler differs.
+BENCHMARK_FLAGS=(
+  --benchmark_repetitions=10
+  --benchmark_enable_random_interleaving=true
+  --benchmark_report_aggregates_only=true
+  --benchmark_out_format=json
+)
+bazel build -c opt --copt=-fno-omit-frame-pointer //example:example_benchmark
+bazel-bin/example/example_benchmark "${BENCHMARK_FLAGS[@]}" \
+  --benchmark_out=baseline.json
+bazel-bin/example/example_benchmark "${BENCHMARK_FLAGS[@]}" \
+  --benchmark_out=profiled.json --cpu_profile=example_benchmark.prof
+
+# The overhead, then the profile.
+python3 tools/compare_benchmarks.py --threshold=0.02 baseline.json profiled.json
+pprof --top bazel-bin/example/example_benchmark example_benchmark.prof
+# --8<-- [end:code]
@@ -0,0 +1,175 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Linux only: sleeps while |*word == expected|, until woken up.
+inline void FutexWait(std::atomic<uint32_t>* word, uint32_t expected) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE,
+            expected, nullptr, nullptr, 0);
+}
+
+inline void FutexWakeAll(std::atomic<uint32_t>* word) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE,
+            INT_MAX, nullptr, nullptr, 0);
+}
+
+// Bounded multi-producer multi-consumer queue (Dmitry Vyukov's algorithm).
+// Every cell has a sequence number telling which lap of the ring it is ready
+// for: producers and consumers claim a position with one CAS and never wait
+// for each other, unless the queue is full or empty.
+//
+// |T| must be default constructible and movable.
+template <typename T>
+class MpmcQueue {
+ public:
+  // |capacity| is rounded up to a power of two.
+  explicit MpmcQueue(size_t capacity)
+      : mask_(absl::bit_ceil(std::max<size_t>(capacity, 2)) - 1),
+        cells_(new Cell[mask_ + 1]) {
+    for (size_t i = 0; i <= mask_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  // Returns false if the queue is full. |value| is moved from only on success,
+  // so a failed push can be retried with the same value:
+  //
+  //   while (!queue.TryPush(std::move(item))) { ... }
+  bool TryPush(T&& value) { return TryPushBatch(absl::MakeSpan(&value, 1)); }
+
+  // Returns false if the queue is empty.
+  bool TryPop(T* value) { return TryPopBatch(absl::MakeSpan(value, 1)); }
+
+  // Moves a prefix of |values| into the queue with a single CAS, returns its
+  // length. The prefix is shorter than |values| if the queue fills up.
+  size_t TryPushBatch(absl::Span<T> values) {
+    size_t position = push_position_.load(std::memory_order_relaxed);
+    size_t n;
+    do {
+      // A cell is free for |position| once the consumer of the previous lap
+      // set its sequence to |position|.
+      n = 0;
+      while (n < values.size() && Sequence(position + n) == position + n) {
+        ++n;
+      }
+      if (n == 0) {
+        if (Sequence(position) < position) {
+          return 0;  // Full: the consumer is a lap behind.
+        }
+        // Another producer claimed |position|, start again from its end.
+        position = push_position_.load(std::memory_order_relaxed);
+        continue;
+      }
+    } while (n == 0 || !push_position_.compare_exchange_weak(
+                           position, position + n, std::memory_order_relaxed));
+
+    for (size_t i = 0; i < n; ++i) {
+      Cell& cell = cells_[(position + i) & mask_];
+      cell.value = std::move(values[i]);
+      cell.sequence.store(position + i + 1, std::memory_order_release);
+    }
+    not_empty_.Notify();
+    return n;
+  }
+
+  // Moves up to |out.size()| values out of the queue with a single CAS,
+  // returns how many.
+  size_t TryPopBatch(absl::Span<T> out) {
+    size_t position = pop_position_.load(std::memory_order_relaxed);
+    size_t n;
+    do {
+      // A cell holds a value for |position| once its producer set the
+      // sequence to |position + 1|.
+      n = 0;
+      while (n < out.size() && Sequence(position + n) == position + n + 1) {
+        ++n;
+      }
+      if (n == 0) {
+        if (Sequence(position) < position + 1) {
+          return 0;  // Empty.
+        }
+        position = pop_position_.load(std::memory_order_relaxed);
+        continue;
+      }
+    } while (n == 0 || !pop_position_.compare_exchange_weak(
+                           position, position + n, std::memory_order_relaxed));
+
+    for (size_t i = 0; i < n; ++i) {
+      Cell& cell = cells_[(position + i) & mask_];
+      out[i] = std::move(cell.value);
+      // Free for the producer of the next lap.
+      cell.sequence.store(position + i + mask_ + 1, std::memory_order_release);
+    }
+    not_full_.Notify();
+    return n;
+  }
+
+  // Blocking versions: sleep in the kernel while the queue is full or empty.
+  void Push(T value) {
+    not_full_.Wait([&] { return TryPush(std::move(value)); });
+  }
+  T Pop() {
+    T value;
+    not_empty_.Wait([&] { return TryPop(&value); });
+    return value;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  // Sleeping threads waiting for the queue to change. Waking costs nothing
+  // while nobody waits: a fence and a load, no system call.
+  class ABSL_CACHELINE_ALIGNED WaitList {
+   public:
+    template <typename F>
+    void Wait(F try_operation) {
+      while (!try_operation()) {
+        waiters_.fetch_add(1, std::memory_order_seq_cst);
+        const uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+        // Retry after announcing ourselves: a |Notify()| racing with the
+        // failed attempt above either sees |waiters_| or changes |epoch_|.
+        if (!try_operation()) {
+          FutexWait(&epoch_, epoch);
+          waiters_.fetch_sub(1, std::memory_order_relaxed);
+          continue;
+        }
+        waiters_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    void Notify() {
+      // Orders the queue update before reading |waiters_|, pairs with the
+      // |fetch_add()| in |Wait()|.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (waiters_.load(std::memory_order_relaxed) > 0) {
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+        FutexWakeAll(&epoch_);
+      }
+    }
+
+   private:
+    std::atomic<uint32_t> epoch_{0};
+    std::atomic<uint32_t> waiters_{0};
+  };
+
+  size_t Sequence(size_t position) const {
+    return cells_[position & mask_].sequence.load(std::memory_order_acquire);
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<Cell[]> cells_;
+  // Producers and consumers update different cache lines.
+  ABSL_CACHELINE_ALIGNED std::atomic<size_t> push_position_{0};
+  ABSL_CACHELINE_ALIGNED std::atomic<size_t> pop_position_{0};
+  WaitList not_empty_;
+  WaitList not_full_;
+};
+// --8<-- [end:code]
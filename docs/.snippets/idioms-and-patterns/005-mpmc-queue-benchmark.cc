@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// The locking of |MyQueue| used as a handoff: every push and pop takes the
+// same |absl::Mutex|.
+class MutexQueue {
+ public:
+  explicit MutexQueue(size_t capacity) : capacity_(capacity) {}
+
+  void Push(int64_t v) {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(
+        +[](MutexQueue* q) { return q->queue_.size() < q->capacity_; }, this));
+    queue_.push_back(v);
+  }
+
+  int64_t Pop() {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(
+        +[](std::deque<int64_t>* q) { return !q->empty(); }, &queue_));
+    const int64_t v = queue_.front();
+    queue_.pop_front();
+    return v;
+  }
+
+ private:
+  const size_t capacity_;
+  absl::Mutex mutex_;
+  std::deque<int64_t> queue_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Half of the threads push the current time, the other half pop it and
+// measure how long the value spent in the queue. Every thread runs the same
+// number of iterations, so all pushed values are popped.
+template <typename Queue>
+void BM_Handoff(benchmark::State& state) {
+  static Queue* queue;
+  if (state.thread_index() == 0) {
+    queue = new Queue(1024);
+  }
+
+  const bool producer = state.thread_index() < state.threads() / 2;
+  int64_t latency_ns = 0;
+  for (auto _ : state) {
+    if (producer) {
+      queue->Push(absl::GetCurrentTimeNanos());
+    } else {
+      latency_ns += absl::GetCurrentTimeNanos() - queue->Pop();
+    }
+  }
+
+  // Counters are summed over the threads, then |kAvgIterations| divides by
+  // the iterations of all threads, producers included, hence the factor 2.
+  if (producer) {
+    state.SetItemsProcessed(state.iterations());
+  } else {
+    state.counters["latency_ns"] = benchmark::Counter(
+        2.0 * latency_ns, benchmark::Counter::kAvgIterations);
+  }
+  if (state.thread_index() == 0) {
+    delete queue;
+  }
+}
+
+// 1P1C, 4P4C and 16P16C.
+BENCHMARK_TEMPLATE(BM_Handoff, MutexQueue)
+    ->Threads(2)
+    ->Threads(8)
+    ->Threads(32)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Handoff, MpmcQueue<int64_t>)
+    ->Threads(2)
+    ->Threads(8)
+    ->Threads(32)
+    ->UseRealTime();
+// --8<-- [end:code]
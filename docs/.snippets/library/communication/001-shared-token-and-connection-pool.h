@@ -0,0 +1,293 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+struct Oauth2Token {
+  std::string access_token;
+  absl::Time expire_time;
+};
+
+// Talks to the token endpoint. Inject a fake, or one pointing to a local
+// stand-in server, in tests.
+class Oauth2TokenFetcher {
+ public:
+  virtual ~Oauth2TokenFetcher() = default;
+
+  virtual absl::StatusOr<Oauth2Token> Fetch() = 0;
+};
+
+// Shared by all |HttpClient| instances of the process. A background thread
+// refreshes the token |refresh_margin| before it expires, so callers only ever
+// take a reader lock and copy a string.
+class Oauth2TokenCache {
+ public:
+  Oauth2TokenCache(std::unique_ptr<Oauth2TokenFetcher> fetcher,
+                   absl::Duration refresh_margin)
+      : fetcher_(std::move(fetcher)), refresh_margin_(refresh_margin) {}
+
+  absl::Status Start() {
+    background_thread_ = std::make_unique<std::thread>(
+        &Oauth2TokenCache::BackgroundThreadEntryPoint, this);
+    return absl::OkStatus();
+  }
+
+  void Stop() {
+    stopping_notification_.Notify();
+    if (background_thread_) {
+      background_thread_->join();
+      background_thread_.reset();
+    }
+  }
+
+  absl::StatusOr<std::string> GetAccessToken() {
+    {
+      absl::ReaderMutexLock lock(&mutex_);
+      if (token_.has_value() && absl::Now() < token_->expire_time) {
+        return token_->access_token;  // Warm path.
+      }
+    }
+
+    // Cold path: no valid token yet. Only one caller fetches, the others wait
+    // on |fetch_mutex_| and then find the fresh token.
+    absl::MutexLock fetch_lock(&fetch_mutex_);
+    {
+      absl::ReaderMutexLock lock(&mutex_);
+      if (token_.has_value() && absl::Now() < token_->expire_time) {
+        return token_->access_token;
+      }
+    }
+    absl::Status s = Refresh();
+    if (!s.ok()) {
+      return s;
+    }
+    absl::ReaderMutexLock lock(&mutex_);
+    return token_->access_token;
+  }
+
+ private:
+  // Calls the fetcher without holding |mutex_|, readers are never blocked by
+  // the network round trip.
+  absl::Status Refresh() ABSL_EXCLUSIVE_LOCKS_REQUIRED(fetch_mutex_) {
+    absl::StatusOr<Oauth2Token> token = fetcher_->Fetch();
+    if (!token.ok()) {
+      return token.status();
+    }
+    absl::MutexLock lock(&mutex_);
+    token_ = *std::move(token);
+    return absl::OkStatus();
+  }
+
+  void BackgroundThreadEntryPoint() {
+    absl::Duration delay = absl::ZeroDuration();
+    while (!stopping_notification_.WaitForNotificationWithTimeout(delay)) {
+      absl::MutexLock fetch_lock(&fetch_mutex_);
+      absl::Status s = Refresh();
+      if (!s.ok()) {
+        // Keep serving the old token until it expires, retry soon.
+        LOG(WARNING) << "Failed to refresh OAuth2 token: " << s;
+        delay = kRetryInterval;
+        continue;
+      }
+      absl::ReaderMutexLock lock(&mutex_);
+      delay = std::max(token_->expire_time - refresh_margin_ - absl::Now(),
+                       kRetryInterval);
+    }
+  }
+
+  static constexpr absl::Duration kRetryInterval = absl::Seconds(1);
+
+  std::unique_ptr<Oauth2TokenFetcher> fetcher_;
+  const absl::Duration refresh_margin_;
+
+  absl::Mutex fetch_mutex_ ABSL_ACQUIRED_BEFORE(mutex_);
+  absl::Mutex mutex_;
+  absl::optional<Oauth2Token> token_ ABSL_GUARDED_BY(mutex_);
+
+  std::unique_ptr<std::thread> background_thread_;
+  absl::Notification stopping_notification_;
+};
+
+// Keeps idle keep-alive connections per endpoint ("host:port") for reuse.
+// Connections are the |File| RAII class from above, extended with move
+// semantics and an |fd()| accessor.
+class ConnectionPool {
+ public:
+  struct Options {
+    size_t max_idle_per_endpoint = 8;
+    absl::Duration idle_timeout = absl::Seconds(30);
+  };
+  // Opens a new connection. Point it at a loopback server in tests.
+  using Dialer = std::function<absl::StatusOr<File>(absl::string_view)>;
+
+  // Returns the connection to the pool on destruction, unless |MarkBroken()|
+  // was called (e.g. after an I/O error or "Connection: close").
+  class Lease {
+   public:
+    Lease(Lease&& other) noexcept
+        : pool_(std::exchange(other.pool_, nullptr)),
+          endpoint_(std::move(other.endpoint_)),
+          connection_(std::move(other.connection_)),
+          reusable_(other.reusable_) {}
+    Lease& operator=(Lease&& other) = delete;
+    ~Lease() {
+      if (pool_ != nullptr && reusable_) {
+        pool_->Release(endpoint_, std::move(connection_));
+      }
+    }
+
+    int fd() const { return connection_.fd(); }
+    void MarkBroken() { reusable_ = false; }
+
+   private:
+    friend class ConnectionPool;
+    Lease(ConnectionPool* pool, std::string endpoint, File connection)
+        : pool_(pool),
+          endpoint_(std::move(endpoint)),
+          connection_(std::move(connection)) {}
+
+    ConnectionPool* pool_;  // Not owned.
+    std::string endpoint_;
+    File connection_;
+    bool reusable_{true};
+  };
+
+  ConnectionPool(Options options, Dialer dialer)
+      : options_(options), dialer_(std::move(dialer)) {}
+
+  absl::StatusOr<Lease> Acquire(absl::string_view endpoint) {
+    for (absl::optional<File> idle = TakeIdle(endpoint); idle.has_value();
+         idle = TakeIdle(endpoint)) {
+      if (IsOpen(idle->fd())) {
+        return Lease(this, std::string(endpoint), *std::move(idle));
+      }
+    }
+
+    absl::StatusOr<File> connection = dialer_(endpoint);
+    if (!connection.ok()) {
+      return connection.status();
+    }
+    return Lease(this, std::string(endpoint), *std::move(connection));
+  }
+
+ private:
+  struct IdleConnection {
+    File file;
+    absl::Time idle_since;
+  };
+
+  // The most recently used connection is the most likely to be alive.
+  absl::optional<File> TakeIdle(absl::string_view endpoint) {
+    absl::MutexLock lock(&mutex_);
+    auto it = idle_.find(endpoint);
+    if (it == idle_.end()) {
+      return absl::nullopt;
+    }
+    std::vector<IdleConnection>& connections = it->second;
+    const absl::Time now = absl::Now();
+    while (!connections.empty()) {
+      IdleConnection idle = std::move(connections.back());
+      connections.pop_back();
+      if (now - idle.idle_since < options_.idle_timeout) {
+        return std::move(idle.file);
+      }
+    }
+    return absl::nullopt;
+  }
+
+  // Servers close idle keep-alive connections on their own schedule, often
+  // before |idle_timeout|. An idle connection has nothing to read: if a peek
+  // finds the end of file, an error or unexpected data, it is not reusable.
+  // A close still on its way is missed, so |Get()| on a reused connection
+  // can still fail.
+  static bool IsOpen(int fd) {
+    char byte;
+    const ssize_t n = ::recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+
+  void Release(const std::string& endpoint, File connection) {
+    absl::MutexLock lock(&mutex_);
+    std::vector<IdleConnection>& connections = idle_[endpoint];
+    if (connections.size() < options_.max_idle_per_endpoint) {
+      connections.push_back({std::move(connection), absl::Now()});
+    }
+  }
+
+  const Options options_;
+  const Dialer dialer_;
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, std::vector<IdleConnection>> idle_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+struct HttpResponse {
+  int status_code;
+  std::string body;
+  bool connection_close;  // The server sent "Connection: close".
+};
+
+struct HttpClientOptions {
+  std::string endpoint;
+  // Shared process-wide, e.g. owned by the service which creates the clients.
+  std::shared_ptr<Oauth2TokenCache> token_cache;
+  std::shared_ptr<ConnectionPool> connection_pool;
+};
+
+class HttpClient {
+ public:
+  static absl::StatusOr<HttpClient> Make(HttpClientOptions options) {
+    HttpClient client(std::move(options));
+    absl::Status s = client.Init();
+    if (!s.ok()) {
+      return s;
+    }
+
+    return client;
+  }
+
+  absl::StatusOr<HttpResponse> Get(absl::string_view path) {
+    absl::StatusOr<std::string> token =
+        options_.token_cache->GetAccessToken();
+    if (!token.ok()) {
+      return token.status();
+    }
+    absl::StatusOr<ConnectionPool::Lease> connection =
+        options_.connection_pool->Acquire(options_.endpoint);
+    if (!connection.ok()) {
+      return connection.status();
+    }
+    absl::StatusOr<HttpResponse> response =
+        SendRequest(connection->fd(), "GET", path, *token);
+    if (!response.ok() || response->connection_close) {
+      connection->MarkBroken();
+    }
+    return response;
+  }
+
+ protected:
+  explicit HttpClient(HttpClientOptions options)
+      : options_(std::move(options)) {}
+
+  // No network round trip any more: once the cache is warm this is a reader
+  // lock plus a string copy.
+  absl::Status Init() {
+    if (options_.token_cache == nullptr ||
+        options_.connection_pool == nullptr) {
+      return absl::InvalidArgumentError(
+          "|token_cache| and |connection_pool| must be assigned.");
+    }
+    return options_.token_cache->GetAccessToken().status();
+  }
+
+ private:
+  static absl::StatusOr<HttpResponse> SendRequest(
+      int fd, absl::string_view method, absl::string_view path,
+      absl::string_view access_token);
+
+  HttpClientOptions options_{};
+};
+// --8<-- [end:code]
@@ -0,0 +1,398 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+using ResponseFuture = std::future<absl::StatusOr<HttpResponse>>;
+
+// Not shown: any HTTP/1.1 parser works, e.g. picohttpparser or llhttp.
+// Parses one response from the front of |buffer|. Returns the number of bytes
+// consumed, or 0 if the response is not complete yet.
+absl::StatusOr<size_t> ParseHttpResponse(absl::string_view buffer,
+                                         HttpResponse* response);
+
+// Sends many requests over a few keep-alive connections to one endpoint, from
+// a single epoll event loop thread.
+//
+// - Pipelining: up to |max_in_flight_per_connection| requests are written to
+//   a connection before the first response arrives. HTTP/1.1 answers them in
+//   order, so each connection keeps a FIFO of requests waiting for a response.
+// - Batching: requests submitted while the loop was busy are appended to the
+//   same write buffer and sent with one write(2).
+// - Backpressure: at most |max_pending| requests wait for a free slot, more
+//   fail fast with |absl::ResourceExhaustedError|.
+// - Deadlines: an expired request fails with |absl::DeadlineExceededError|. If
+//   it was already sent, its response is read and discarded when it arrives,
+//   because a pipelined request cannot be cancelled on its own.
+class HttpPipeline {
+ public:
+  struct Options {
+    std::string endpoint;
+    int num_connections = 4;
+    size_t max_in_flight_per_connection = 32;
+    size_t max_pending = 4096;
+  };
+
+  HttpPipeline(Options options, ConnectionPool::Dialer dialer)
+      : options_(std::move(options)), dialer_(std::move(dialer)) {}
+
+  absl::Status Start() {
+    epoll_fd_ = File(::epoll_create1(EPOLL_CLOEXEC));
+    wakeup_fd_ = File(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (!epoll_fd_.valid() || !wakeup_fd_.valid()) {
+      return absl::InternalError("Failed to create epoll/eventfd.");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;  // nullptr stands for |wakeup_fd_|.
+    ::epoll_ctl(epoll_fd_.fd(), EPOLL_CTL_ADD, wakeup_fd_.fd(), &event);
+
+    connections_.resize(options_.num_connections);
+    for (Connection& connection : connections_) {
+      absl::Status s = Connect(&connection);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    event_loop_thread_ = std::make_unique<std::thread>(
+        &HttpPipeline::EventLoopEntryPoint, this);
+    return absl::OkStatus();
+  }
+
+  void Stop() {
+    stopping_.store(true, std::memory_order_release);
+    Wakeup();
+    if (event_loop_thread_) {
+      event_loop_thread_->join();
+      event_loop_thread_.reset();
+    }
+  }
+
+  // Thread-safe. |request| is a complete, serialized HTTP/1.1 request. Fails
+  // with |absl::CancelledError| once |Stop()| has been called.
+  ResponseFuture Submit(std::string request, absl::Time deadline) {
+    auto call = std::make_shared<Call>();
+    call->request = std::move(request);
+    call->deadline = deadline;
+    ResponseFuture future = call->promise.get_future();
+    Enqueue(std::move(call));
+    return future;
+  }
+
+ private:
+  struct Call {
+    std::string request;
+    absl::Time deadline;
+    std::promise<absl::StatusOr<HttpResponse>> promise;
+    bool done = false;  // Promise fulfilled, e.g. by the deadline.
+
+    void Finish(absl::StatusOr<HttpResponse> result) {
+      if (!done) {
+        done = true;
+        promise.set_value(std::move(result));
+      }
+    }
+  };
+
+  // Hands |call| to the event loop, or finishes it right away on the calling
+  // thread.
+  void Enqueue(std::shared_ptr<Call> call) {
+    absl::Status rejected;
+    bool was_empty = false;
+    {
+      absl::MutexLock lock(&submit_mutex_);
+      // Checked under the lock the loop's final drain takes: either the drain
+      // cancels the call, or the call sees |stopping_|.
+      if (stopping_.load(std::memory_order_acquire)) {
+        rejected = absl::CancelledError("HttpPipeline stopped.");
+      } else if (submitted_.size() +
+                     num_waiting_.load(std::memory_order_relaxed) >=
+                 options_.max_pending) {
+        rejected = absl::ResourceExhaustedError("Too many pending requests.");
+      } else {
+        was_empty = submitted_.empty();
+        submitted_.push_back(std::move(call));
+      }
+    }
+    if (!rejected.ok()) {
+      call->Finish(std::move(rejected));  // Not shared with the loop yet.
+      return;
+    }
+    // The loop drains the whole queue per wakeup, one write(2) is enough.
+    if (was_empty) {
+      Wakeup();
+    }
+  }
+
+  struct Connection {
+    File socket;
+    std::string write_buffer;
+    size_t written = 0;
+    std::string read_buffer;
+    std::deque<std::shared_ptr<Call>> in_flight;
+  };
+
+  void Wakeup() {
+    const uint64_t one = 1;
+    ignore_result(::write(wakeup_fd_.fd(), &one, sizeof(one)));
+  }
+
+  absl::Status Connect(Connection* connection) {
+    absl::StatusOr<File> socket = dialer_(options_.endpoint);
+    if (!socket.ok()) {
+      return socket.status();
+    }
+    connection->socket = *std::move(socket);
+    ::fcntl(connection->socket.fd(), F_SETFL, O_NONBLOCK);
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = connection;
+    ::epoll_ctl(epoll_fd_.fd(), EPOLL_CTL_ADD, connection->socket.fd(),
+                &event);
+    return absl::OkStatus();
+  }
+
+  void EventLoopEntryPoint() {
+    std::array<epoll_event, 64> events;
+    while (!stopping_.load(std::memory_order_acquire)) {
+      const int n = ::epoll_wait(epoll_fd_.fd(), events.data(), events.size(),
+                                 NextTimeoutMillis());
+      for (int i = 0; i < n; ++i) {
+        auto* connection = static_cast<Connection*>(events[i].data.ptr);
+        if (connection == nullptr) {
+          uint64_t count;
+          ignore_result(::read(wakeup_fd_.fd(), &count, sizeof(count)));
+          continue;
+        }
+        // On a closed or broken connection too: the responses which arrived
+        // before still count.
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+          ReadResponses(connection);
+        }
+        if (connection->socket.valid() && (events[i].events & EPOLLOUT)) {
+          Flush(connection);
+        }
+      }
+      Dispatch();
+      ExpireDeadlines(absl::Now());
+    }
+
+    // |stopping_| is set: no |Submit()| adds to |submitted_| after this lock.
+    {
+      absl::MutexLock lock(&submit_mutex_);
+      waiting_.insert(waiting_.end(), submitted_.begin(), submitted_.end());
+      submitted_.clear();
+    }
+    for (const std::shared_ptr<Call>& call : waiting_) {
+      call->Finish(absl::CancelledError("HttpPipeline stopped."));
+    }
+    for (Connection& connection : connections_) {
+      Fail(&connection, absl::CancelledError("HttpPipeline stopped."));
+    }
+  }
+
+  // Moves submitted calls into free pipeline slots, one write per connection.
+  void Dispatch() {
+    {
+      absl::MutexLock lock(&submit_mutex_);
+      waiting_.insert(waiting_.end(), submitted_.begin(), submitted_.end());
+      submitted_.clear();
+    }
+    for (Connection& connection : connections_) {
+      if (waiting_.empty()) {
+        break;
+      }
+      if (!connection.socket.valid() && !Connect(&connection).ok()) {
+        continue;
+      }
+      const size_t before = connection.in_flight.size();
+      while (!waiting_.empty() && connection.in_flight.size() <
+                                      options_.max_in_flight_per_connection) {
+        std::shared_ptr<Call> call = std::move(waiting_.front());
+        waiting_.pop_front();
+        if (call->done) {
+          continue;  // Expired while waiting.
+        }
+        connection.write_buffer.append(call->request);
+        connection.in_flight.push_back(std::move(call));
+      }
+      if (connection.in_flight.size() != before) {
+        Flush(&connection);
+      }
+    }
+    num_waiting_.store(waiting_.size(), std::memory_order_relaxed);
+  }
+
+  void Flush(Connection* connection) {
+    while (connection->written < connection->write_buffer.size()) {
+      const ssize_t n = ::write(
+          connection->socket.fd(),
+          connection->write_buffer.data() + connection->written,
+          connection->write_buffer.size() - connection->written);
+      if (n < 0) {
+        if (errno != EAGAIN) {
+          Fail(connection, absl::UnavailableError("write() failed."));
+        }
+        return;  // Wait for EPOLLOUT.
+      }
+      connection->written += n;
+    }
+    connection->write_buffer.clear();
+    connection->written = 0;
+  }
+
+  // Parses every complete response before it handles the end of the
+  // connection, so that a server which answers and then closes (e.g. with
+  // "Connection: close") delivers its last responses.
+  void ReadResponses(Connection* connection) {
+    char buffer[64 * 1024];
+    bool closed = false;
+    while (true) {
+      const ssize_t n = ::read(connection->socket.fd(), buffer, sizeof(buffer));
+      if (n > 0) {
+        connection->read_buffer.append(buffer, n);
+      } else if (n < 0 && errno == EAGAIN) {
+        break;  // Drained.
+      } else {
+        closed = true;  // End of file, or an error.
+        break;
+      }
+    }
+
+    size_t offset = 0;
+    while (!connection->in_flight.empty()) {
+      HttpResponse response;
+      absl::StatusOr<size_t> consumed = ParseHttpResponse(
+          absl::string_view(connection->read_buffer).substr(offset),
+          &response);
+      if (!consumed.ok()) {
+        Fail(connection, consumed.status());
+        return;
+      }
+      if (*consumed == 0) {
+        break;
+      }
+      offset += *consumed;
+      const bool connection_close = response.connection_close;
+      connection->in_flight.front()->Finish(std::move(response));
+      connection->in_flight.pop_front();
+      if (connection_close) {
+        // The server closes the connection after this response: nothing
+        // more is pipelined on it, and the requests behind get no response.
+        closed = true;
+        break;
+      }
+    }
+    connection->read_buffer.erase(0, offset);
+    if (closed) {
+      Fail(connection, absl::UnavailableError("Connection closed."));
+    }
+  }
+
+  // Fails everything sent on |connection| and closes it. It is reconnected on
+  // the next |Dispatch()|. Requests are not retried: they may not be
+  // idempotent.
+  void Fail(Connection* connection, const absl::Status& status) {
+    for (const std::shared_ptr<Call>& call : connection->in_flight) {
+      call->Finish(status);
+    }
+    connection->in_flight.clear();
+    connection->write_buffer.clear();
+    connection->written = 0;
+    connection->read_buffer.clear();
+    connection->socket = File();  // Closing also removes it from epoll.
+  }
+
+  // A linear scan is fine for thousands of calls. Use a timer heap or wheel
+  // beyond that.
+  void ExpireDeadlines(absl::Time now) {
+    auto expire = [now](const std::shared_ptr<Call>& call) {
+      if (call->deadline <= now) {
+        call->Finish(absl::DeadlineExceededError("Deadline exceeded."));
+      }
+    };
+    std::for_each(waiting_.begin(), waiting_.end(), expire);
+    for (Connection& connection : connections_) {
+      std::for_each(connection.in_flight.begin(), connection.in_flight.end(),
+                    expire);
+    }
+  }
+
+  int NextTimeoutMillis() const {
+    absl::Time next = absl::InfiniteFuture();
+    auto update = [&next](const std::shared_ptr<Call>& call) {
+      if (!call->done) {
+        next = std::min(next, call->deadline);
+      }
+    };
+    std::for_each(waiting_.begin(), waiting_.end(), update);
+    for (const Connection& connection : connections_) {
+      std::for_each(connection.in_flight.begin(), connection.in_flight.end(),
+                    update);
+    }
+    if (next == absl::InfiniteFuture()) {
+      return -1;
+    }
+    return static_cast<int>(std::max<int64_t>(
+        absl::ToInt64Milliseconds(absl::Ceil(next - absl::Now(),
+                                             absl::Milliseconds(1))),
+        0));
+  }
+
+  const Options options_;
+  const ConnectionPool::Dialer dialer_;
+
+  File epoll_fd_;
+  File wakeup_fd_;
+  std::unique_ptr<std::thread> event_loop_thread_;
+  std::atomic<bool> stopping_{false};
+
+  absl::Mutex submit_mutex_;
+  std::vector<std::shared_ptr<Call>> submitted_ ABSL_GUARDED_BY(submit_mutex_);
+  std::atomic<size_t> num_waiting_{0};  // |waiting_.size()|, for |Submit()|.
+
+  // Owned by the event loop thread.
+  std::deque<std::shared_ptr<Call>> waiting_;
+  std::vector<Connection> connections_;
+};
+
+// |HttpClient| gets an asynchronous sibling of |Get()|. Like the token cache,
+// the pipeline is shared by all clients.
+struct HttpClientOptions {
+  // Omitted: the fields shown above.
+
+  std::shared_ptr<HttpPipeline> pipeline;
+};
+
+class HttpClient {
+ public:
+  // Omitted: the members shown above.
+
+  // Example:
+  //   std::vector<ResponseFuture> responses;
+  //   for (const std::string& path : paths) {
+  //     responses.push_back(client.GetAsync(path, absl::Milliseconds(200)));
+  //   }
+  //   for (ResponseFuture& response : responses) {
+  //     absl::StatusOr<HttpResponse> r = response.get();
+  //     // ...
+  //   }
+  ResponseFuture GetAsync(absl::string_view path, absl::Duration timeout);
+};
+
+ResponseFuture HttpClient::GetAsync(absl::string_view path,
+                                    absl::Duration timeout) {
+  absl::StatusOr<std::string> token = options_.token_cache->GetAccessToken();
+  if (!token.ok()) {
+    std::promise<absl::StatusOr<HttpResponse>> failed;
+    failed.set_value(token.status());
+    return failed.get_future();
+  }
+  return options_.pipeline->Submit(
+      absl::StrCat("GET ", path, " HTTP/1.1\r\nHost: ", options_.endpoint,
+                   "\r\nAuthorization: Bearer ", *token, "\r\n\r\n"),
+      absl::Now() + timeout);
+}
+// --8<-- [end:code]
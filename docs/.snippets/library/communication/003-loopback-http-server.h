@@ -0,0 +1,206 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// A stand-in HTTP/1.1 server on 127.0.0.1 for tests and benchmarks. Every
+// request, i.e. everything up to an empty line, gets the same small response.
+// One thread per connection, and the responses to all requests of one read(2)
+// go out with one write(2), so pipelining pays off as it would against a real
+// server.
+class LoopbackHttpServer {
+ public:
+  struct Options {
+    // After this many responses on a connection, the last one says
+    // "Connection: close" and the server closes the connection. 0 for never.
+    int max_responses_per_connection = 0;
+  };
+
+  explicit LoopbackHttpServer(Options options) : options_(options) {}
+  ~LoopbackHttpServer() { Stop(); }
+
+  absl::Status Start() {
+    listener_ = File(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    auto* addr = reinterpret_cast<sockaddr*>(&address);
+    if (!listener_.valid() || ::bind(listener_.fd(), addr, size) != 0 ||
+        ::listen(listener_.fd(), SOMAXCONN) != 0 ||
+        ::getsockname(listener_.fd(), addr, &size) != 0) {
+      return IOError("loopback listener", errno);
+    }
+    port_ = ntohs(address.sin_port);
+    accept_thread_ = std::make_unique<std::thread>(
+        &LoopbackHttpServer::AcceptThreadEntryPoint, this);
+    return absl::OkStatus();
+  }
+
+  // Closes the connections which are still open.
+  void Stop() {
+    if (accept_thread_ == nullptr) {
+      return;
+    }
+    ::shutdown(listener_.fd(), SHUT_RDWR);  // Wakes up accept(2).
+    accept_thread_->join();
+    accept_thread_.reset();
+    std::vector<std::thread> threads;
+    {
+      absl::MutexLock lock(&mutex_);
+      for (int fd : open_connections_) {
+        ::shutdown(fd, SHUT_RDWR);  // Wakes up read(2).
+      }
+      threads.swap(connection_threads_);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::string endpoint() const { return absl::StrCat("127.0.0.1:", port_); }
+
+  // Connections accepted so far.
+  int64_t num_accepted() const { return num_accepted_.load(); }
+
+  // A |ConnectionPool::Dialer| for |endpoint()|.
+  static absl::StatusOr<File> Dial(absl::string_view endpoint) {
+    const size_t colon = endpoint.rfind(':');
+    int port;
+    if (colon == absl::string_view::npos ||
+        !absl::SimpleAtoi(endpoint.substr(colon + 1), &port)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad endpoint: ", endpoint));
+    }
+    File socket(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (!socket.valid() ||
+        ::connect(socket.fd(), reinterpret_cast<sockaddr*>(&address),
+                  sizeof(address)) != 0) {
+      return IOError(std::string(endpoint), errno);
+    }
+    const int one = 1;
+    ::setsockopt(socket.fd(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return socket;
+  }
+
+ private:
+  static constexpr absl::string_view kResponse =
+      "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+  static constexpr absl::string_view kLastResponse =
+      "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+
+  void AcceptThreadEntryPoint() {
+    while (true) {
+      File connection(
+          ::accept4(listener_.fd(), nullptr, nullptr, SOCK_CLOEXEC));
+      if (!connection.valid()) {
+        return;  // Stopped.
+      }
+      num_accepted_.fetch_add(1);
+      const int one = 1;
+      ::setsockopt(connection.fd(), IPPROTO_TCP, TCP_NODELAY, &one,
+                   sizeof(one));
+      absl::MutexLock lock(&mutex_);
+      open_connections_.insert(connection.fd());
+      connection_threads_.emplace_back(&LoopbackHttpServer::Serve, this,
+                                       std::move(connection));
+    }
+  }
+
+  void Serve(File connection) {
+    std::string requests;
+    std::string responses;
+    char buffer[64 * 1024];
+    int served = 0;
+    bool last = false;
+    ssize_t n;
+    while (!last &&
+           (n = ::read(connection.fd(), buffer, sizeof(buffer))) > 0) {
+      requests.append(buffer, n);
+      size_t offset = 0;
+      size_t end;
+      while (!last &&
+             (end = requests.find("\r\n\r\n", offset)) != std::string::npos) {
+        offset = end + 4;
+        last = ++served == options_.max_responses_per_connection;
+        absl::StrAppend(&responses, last ? kLastResponse : kResponse);
+      }
+      requests.erase(0, offset);
+      if (!WriteAll(connection.fd(), responses)) {
+        break;
+      }
+      responses.clear();
+    }
+    if (last) {
+      // Closing with unread requests would send a reset, which may destroy
+      // the responses the client has not read yet. Send a FIN instead and
+      // wait for the client to close.
+      ::shutdown(connection.fd(), SHUT_WR);
+      while (::read(connection.fd(), buffer, sizeof(buffer)) > 0) {
+      }
+    }
+    absl::MutexLock lock(&mutex_);
+    open_connections_.erase(connection.fd());
+  }  // Closes |connection|, after it left |open_connections_|.
+
+  static bool WriteAll(int fd, absl::string_view data) {
+    while (!data.empty()) {
+      const ssize_t n = ::write(fd, data.data(), data.size());
+      if (n <= 0) {
+        return false;
+      }
+      data.remove_prefix(n);
+    }
+    return true;
+  }
+
+  const Options options_;
+  File listener_;
+  int port_ = 0;
+  std::unique_ptr<std::thread> accept_thread_;
+  std::atomic<int64_t> num_accepted_{0};
+
+  absl::Mutex mutex_;
+  absl::flat_hash_set<int> open_connections_ ABSL_GUARDED_BY(mutex_);
+  std::vector<std::thread> connection_threads_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Enough of |ParseHttpResponse()| for the responses of |LoopbackHttpServer|:
+// the status line, Content-Length and "Connection: close". Use a real parser
+// for anything else.
+absl::StatusOr<size_t> ParseHttpResponse(absl::string_view buffer,
+                                         HttpResponse* response) {
+  const size_t header_end = buffer.find("\r\n\r\n");
+  if (header_end == absl::string_view::npos) {
+    return 0;
+  }
+  const absl::string_view header = buffer.substr(0, header_end);
+  constexpr absl::string_view kContentLength = "\r\nContent-Length: ";
+  const size_t length_start = header.find(kContentLength);
+  if (!absl::StartsWith(header, "HTTP/1.1 ") ||
+      !absl::SimpleAtoi(header.substr(9, 3), &response->status_code) ||
+      length_start == absl::string_view::npos) {
+    return absl::DataLossError("Malformed HTTP response.");
+  }
+  absl::string_view length_value =
+      header.substr(length_start + kContentLength.size());
+  length_value = length_value.substr(0, length_value.find("\r\n"));
+  size_t length;
+  if (!absl::SimpleAtoi(length_value, &length)) {
+    return absl::DataLossError("Malformed Content-Length.");
+  }
+  if (buffer.size() < header_end + 4 + length) {
+    return 0;
+  }
+  response->body = std::string(buffer.substr(header_end + 4, length));
+  response->connection_close =
+      absl::StrContains(header, "\r\nConnection: close");
+  return header_end + 4 + length;
+}
+// --8<-- [end:code]
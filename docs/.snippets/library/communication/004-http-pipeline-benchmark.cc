@@ -0,0 +1,76 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Keeps |concurrency| requests outstanding against a |LoopbackHttpServer|
+// until |num_requests| are done. The latency of a request runs from
+// |Submit()| until its future is ready; the futures are waited for in order,
+// so a slow request also delays the latency of the ones behind it, as it
+// would for a caller that needs all of them.
+void BenchmarkHttpPipeline(absl::string_view name, int num_connections,
+                           size_t max_in_flight_per_connection,
+                           int concurrency, int num_requests) {
+  LoopbackHttpServer server(LoopbackHttpServer::Options{});
+  CHECK_OK(server.Start());
+  HttpPipeline::Options options;
+  options.endpoint = server.endpoint();
+  options.num_connections = num_connections;
+  options.max_in_flight_per_connection = max_in_flight_per_connection;
+  HttpPipeline pipeline(options, &LoopbackHttpServer::Dial);
+  CHECK_OK(pipeline.Start());
+
+  const std::string request = absl::StrCat(
+      "GET /ping HTTP/1.1\r\nHost: ", options.endpoint, "\r\n\r\n");
+  std::deque<std::pair<ResponseFuture, int64_t>> outstanding;
+  std::vector<int64_t> latencies_ns;
+  latencies_ns.reserve(num_requests);
+  int failed = 0;
+  auto wait_for_oldest = [&]() {
+    absl::StatusOr<HttpResponse> response = outstanding.front().first.get();
+    latencies_ns.push_back(absl::GetCurrentTimeNanos() -
+                           outstanding.front().second);
+    failed += !response.ok();
+    outstanding.pop_front();
+  };
+
+  const absl::Time start = absl::Now();
+  for (int i = 0; i < num_requests; ++i) {
+    if (outstanding.size() == static_cast<size_t>(concurrency)) {
+      wait_for_oldest();
+    }
+    const int64_t submitted_ns = absl::GetCurrentTimeNanos();
+    outstanding.emplace_back(
+        pipeline.Submit(request, absl::Now() + absl::Seconds(10)),
+        submitted_ns);
+  }
+  while (!outstanding.empty()) {
+    wait_for_oldest();
+  }
+  const absl::Duration elapsed = absl::Now() - start;
+  pipeline.Stop();
+  server.Stop();
+
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  absl::PrintF("%s: %.0f requests/s p50=%dus p99=%dus failed=%d\n", name,
+               num_requests / absl::ToDoubleSeconds(elapsed),
+               latencies_ns[latencies_ns.size() / 2] / 1000,
+               latencies_ns[latencies_ns.size() * 99 / 100] / 1000, failed);
+}
+
+// 1k requests outstanding. One request per connection at a time is HTTP/1.1
+// without pipelining: to get the same concurrency, it would need 1k
+// connections.
+void CompareHttpPipelines() {
+  constexpr int kConcurrency = 1000;
+  constexpr int kRequests = 200000;
+  BenchmarkHttpPipeline("4 connections, 1 in flight each", 4, 1,
+                        kConcurrency, kRequests);
+  BenchmarkHttpPipeline("4 connections, 32 in flight each", 4, 32,
+                        kConcurrency, kRequests);
+  BenchmarkHttpPipeline("1 connection, 256 in flight", 1, 256, kConcurrency,
+                        kRequests);
+  BenchmarkHttpPipeline("16 connections, 64 in flight each", 16, 64,
+                        kConcurrency, kRequests);
+}
+// --8<-- [end:code]
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Enough of |SendRequest()| for |LoopbackHttpServer|: a blocking write of the
+// request, then reads until |ParseHttpResponse()| has a whole response.
+absl::StatusOr<HttpResponse> HttpClient::SendRequest(
+    int fd, absl::string_view method, absl::string_view path,
+    absl::string_view access_token) {
+  const std::string request =
+      absl::StrCat(method, " ", path, " HTTP/1.1\r\nAuthorization: Bearer ",
+                   access_token, "\r\n\r\n");
+  if (::write(fd, request.data(), request.size()) !=
+      static_cast<ssize_t>(request.size())) {
+    return absl::UnavailableError("write() failed.");
+  }
+  std::string buffer;
+  char chunk[4096];
+  while (true) {
+    HttpResponse response;
+    absl::StatusOr<size_t> consumed = ParseHttpResponse(buffer, &response);
+    if (!consumed.ok()) {
+      return consumed.status();
+    }
+    if (*consumed > 0) {
+      return response;
+    }
+    const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+    if (n <= 0) {
+      return absl::UnavailableError("Connection closed.");
+    }
+    buffer.append(chunk, n);
+  }
+}
+
+// Never expires, so the cache stays warm.
+class FixedTokenFetcher : public Oauth2TokenFetcher {
+ public:
+  absl::StatusOr<Oauth2Token> Fetch() override {
+    return Oauth2Token{"token", absl::InfiniteFuture()};
+  }
+};
+
+// A client per request, as in |HttpClient::Make(...)->Get(path)|, with
+// |max_idle_per_endpoint| idle connections kept by the pool. 0 dials a new
+// connection per request.
+void BM_MakeAndGet(benchmark::State& state) {
+  LoopbackHttpServer server(LoopbackHttpServer::Options{});
+  CHECK_OK(server.Start());
+  auto token_cache = std::make_shared<Oauth2TokenCache>(
+      std::make_unique<FixedTokenFetcher>(), absl::Minutes(5));
+  ConnectionPool::Options pool_options;
+  pool_options.max_idle_per_endpoint = state.range(0);
+  auto connection_pool = std::make_shared<ConnectionPool>(
+      pool_options, &LoopbackHttpServer::Dial);
+  const HttpClientOptions options{server.endpoint(), token_cache,
+                                  connection_pool};
+  for (auto _ : state) {
+    absl::StatusOr<HttpClient> client = HttpClient::Make(options);
+    CHECK_OK(client.status());
+    CHECK_OK(client->Get("/ping").status());
+  }
+  state.counters["connections"] = server.num_accepted();
+}
+BENCHMARK(BM_MakeAndGet)->Arg(0)->Arg(8);
+
+// Only |Make()|, with a warm token cache.
+void BM_Make(benchmark::State& state) {
+  auto token_cache = std::make_shared<Oauth2TokenCache>(
+      std::make_unique<FixedTokenFetcher>(), absl::Minutes(5));
+  const HttpClientOptions options{
+      "127.0.0.1:1", token_cache,
+      std::make_shared<ConnectionPool>(ConnectionPool::Options{},
+                                       &LoopbackHttpServer::Dial)};
+  CHECK_OK(token_cache->GetAccessToken().status());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(HttpClient::Make(options));
+  }
+}
+BENCHMARK(BM_Make);
+// --8<-- [end:code]
@@ -0,0 +1,359 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// A logger for hot paths. The calling thread does not format anything: it
+// copies a pointer to the static call site (format string, file, line), a
+// timestamp and the raw arguments into a ring buffer of its own. A background
+// thread drains all buffers, formats the lines and writes them in one
+// |writev()| per round.
+//
+// Usage, with an |absl::StrFormat()| format string:
+//   ASYNC_LOG(logger, "Got %d bytes from %s", size, peer_name);
+//
+// Arguments must be arithmetic or convertible to |absl::string_view|. Strings
+// are copied (at most |kMaxStringSize| bytes), so they may die right after
+// the call.
+enum class OverflowPolicy {
+  kDrop,   // Count the message as dropped and return immediately.
+  kBlock,  // Wait until the background thread has made room.
+};
+
+struct AsyncLoggerOptions {
+  int fd = STDERR_FILENO;
+  size_t buffer_size_per_thread = size_t{1} << 20;  // Power of two.
+  OverflowPolicy overflow_policy = OverflowPolicy::kDrop;
+  absl::Duration flush_interval = absl::Milliseconds(1);
+};
+
+struct LogSite {
+  const char* format;
+  const char* file;
+  int line;
+};
+
+#define ASYNC_LOG(logger, format, ...)                                \
+  do {                                                                \
+    static constexpr LogSite kLogSite = {format, __FILE__, __LINE__}; \
+    (logger).Log(&kLogSite __VA_OPT__(, ) __VA_ARGS__);               \
+  } while (false)
+
+namespace internal_async_log {
+
+inline constexpr size_t kMaxStringSize = 1024;
+
+// How an argument is stored in the ring buffer.
+template <typename T>
+using WireType =
+    std::conditional_t<std::is_convertible_v<const T&, absl::string_view>,
+                       absl::string_view, T>;
+
+template <typename T>
+size_t EncodedSize(const T&) {
+  static_assert(std::is_arithmetic_v<T>, "Unsupported log argument.");
+  return sizeof(T);
+}
+inline size_t EncodedSize(absl::string_view s) {
+  return sizeof(uint32_t) + std::min(s.size(), kMaxStringSize);
+}
+
+template <typename T>
+char* Encode(char* p, const T& v) {
+  std::memcpy(p, &v, sizeof(T));
+  return p + sizeof(T);
+}
+inline char* Encode(char* p, absl::string_view s) {
+  const auto size = static_cast<uint32_t>(std::min(s.size(), kMaxStringSize));
+  std::memcpy(p, &size, sizeof(size));
+  std::memcpy(p + sizeof(size), s.data(), size);
+  return p + sizeof(size) + size;
+}
+
+template <typename T>
+const char* Decode(const char* p, T* v) {
+  std::memcpy(v, p, sizeof(T));
+  return p + sizeof(T);
+}
+// The result points into the ring buffer, valid until the record is consumed.
+inline const char* Decode(const char* p, absl::string_view* s) {
+  uint32_t size;
+  std::memcpy(&size, p, sizeof(size));
+  *s = absl::string_view(p + sizeof(size), size);
+  return p + sizeof(size) + size;
+}
+
+// Instantiated once per list of argument types, and stored in every record:
+// the background thread finds the types of the arguments through it.
+using FormatFunction = void (*)(const char* format, const char* args,
+                                std::string* out);
+
+template <typename... Wire>
+void FormatRecord(const char* format, const char* args, std::string* out) {
+  std::tuple<Wire...> values;
+  std::apply([&](Wire&... v) { ((args = Decode(args, &v)), ...); }, values);
+  std::apply(
+      [&](const Wire&... v) {
+        if (!absl::FormatUntyped(out, absl::UntypedFormatSpec(format),
+                                 {absl::FormatArg(v)...})) {
+          out->append("<bad format>");
+        }
+      },
+      values);
+}
+
+struct RecordHeader {
+  uint32_t size;  // Including the header, a multiple of 8.
+  FormatFunction format;  // nullptr: padding up to the end of the ring.
+  const LogSite* site;
+  int64_t time_ns;
+};
+
+// Single-producer single-consumer byte ring. Records never wrap around: if
+// one does not fit before the end of the ring, the rest of the ring is
+// skipped. Positions only grow, |position & mask_| is the offset.
+class ThreadBuffer {
+ public:
+  explicit ThreadBuffer(size_t capacity)
+      : mask_(capacity - 1), data_(new char[capacity]) {}
+
+  // Producer: returns where to write |size| bytes, or nullptr if full.
+  char* TryReserve(size_t size) {
+    const uint64_t write = write_.load(std::memory_order_relaxed);
+    const uint64_t read = read_.load(std::memory_order_acquire);
+    const size_t offset = write & mask_;
+    const size_t to_end = mask_ + 1 - offset;
+    const size_t skip = to_end < size ? to_end : 0;
+    if (write + skip + size - read > mask_ + 1) {
+      return nullptr;
+    }
+    if (skip >= sizeof(RecordHeader)) {
+      RecordHeader padding = {};
+      std::memcpy(&data_[offset], &padding, sizeof(padding));
+    }
+    reserved_end_ = write + skip + size;
+    return &data_[(write + skip) & mask_];
+  }
+
+  // Producer: publishes the record written after |TryReserve()|.
+  void Commit() { write_.store(reserved_end_, std::memory_order_release); }
+
+  // Consumer: formats every committed record into |out|.
+  void Drain(std::string* out) {
+    uint64_t read = read_.load(std::memory_order_relaxed);
+    const uint64_t write = write_.load(std::memory_order_acquire);
+    while (read < write) {
+      const size_t offset = read & mask_;
+      const size_t to_end = mask_ + 1 - offset;
+      RecordHeader header;
+      if (to_end < sizeof(header)) {
+        read += to_end;
+        continue;
+      }
+      std::memcpy(&header, &data_[offset], sizeof(header));
+      if (header.format == nullptr) {
+        read += to_end;
+        continue;
+      }
+      AppendLinePrefix(header, out);
+      header.format(header.site->format, &data_[offset + sizeof(header)], out);
+      out->push_back('\n');
+      read += header.size;
+    }
+    read_.store(read, std::memory_order_release);
+
+    if (const uint64_t dropped = dropped_.exchange(0)) {
+      absl::StrAppend(out, "[async log] ", dropped, " messages dropped.\n");
+    }
+  }
+
+  void CountDropped() { dropped_.fetch_add(1, std::memory_order_relaxed); }
+
+  // Set when the producer thread exits, the buffer is removed once drained.
+  std::atomic<bool> abandoned{false};
+
+ private:
+  static void AppendLinePrefix(const RecordHeader& header, std::string* out) {
+    absl::StrAppend(out, "I",
+                    absl::FormatTime("%m%d %H:%M:%E6S ",
+                                     absl::FromUnixNanos(header.time_ns),
+                                     absl::LocalTimeZone()),
+                    header.site->file, ":", header.site->line, "] ");
+  }
+
+  const size_t mask_;
+  const std::unique_ptr<char[]> data_;
+  // Written by the producer only, read by the consumer.
+  ABSL_CACHELINE_ALIGNED std::atomic<uint64_t> write_{0};
+  uint64_t reserved_end_ = 0;
+  // Written by the consumer only, read by the producer.
+  ABSL_CACHELINE_ALIGNED std::atomic<uint64_t> read_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace internal_async_log
+
+// Meant to be a single process-wide instance: every thread keeps one buffer
+// for the last logger it logged to.
+class AsyncLogger {
+ public:
+  explicit AsyncLogger(AsyncLoggerOptions options)
+      : options_(std::move(options)) {}
+
+  absl::Status Start() {
+    background_thread_ = std::make_unique<std::thread>(
+        &AsyncLogger::BackgroundThreadEntryPoint, this);
+    return absl::OkStatus();
+  }
+
+  // Writes everything logged before the call.
+  void Stop() {
+    stopping_notification_.Notify();
+    if (background_thread_) {
+      background_thread_->join();
+      background_thread_.reset();
+    }
+  }
+
+  template <typename... Args>
+  void Log(const LogSite* site, const Args&... args) {
+    using internal_async_log::RecordHeader;
+    using internal_async_log::WireType;
+    const size_t args_size =
+        (internal_async_log::EncodedSize(WireType<Args>(args)) + ... + 0);
+    // Keep records 8-byte aligned, so that a padding header always fits.
+    const size_t size = (sizeof(RecordHeader) + args_size + 7) & ~size_t{7};
+    internal_async_log::ThreadBuffer* buffer = ThisThreadBuffer();
+    if (size > options_.buffer_size_per_thread / 2) {
+      buffer->CountDropped();
+      return;
+    }
+
+    char* p = buffer->TryReserve(size);
+    while (p == nullptr) {
+      if (options_.overflow_policy == OverflowPolicy::kDrop) {
+        buffer->CountDropped();
+        return;
+      }
+      std::this_thread::yield();
+      p = buffer->TryReserve(size);
+    }
+    const RecordHeader header = {
+        static_cast<uint32_t>(size),
+        &internal_async_log::FormatRecord<WireType<Args>...>, site,
+        absl::GetCurrentTimeNanos()};
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    ((p = internal_async_log::Encode(p, WireType<Args>(args))), ...);
+    buffer->Commit();
+  }
+
+ private:
+  internal_async_log::ThreadBuffer* ThisThreadBuffer() {
+    // Marks the buffer as abandoned when the thread exits, the logger keeps
+    // it alive until the background thread has drained it.
+    struct Registration {
+      ~Registration() {
+        if (buffer != nullptr) {
+          buffer->abandoned.store(true, std::memory_order_release);
+        }
+      }
+      uint64_t logger_id = 0;
+      std::shared_ptr<internal_async_log::ThreadBuffer> buffer;
+    };
+    thread_local Registration registration;
+    if (ABSL_PREDICT_FALSE(registration.logger_id != id_)) {
+      if (registration.buffer != nullptr) {
+        registration.buffer->abandoned.store(true, std::memory_order_release);
+      }
+      registration.logger_id = id_;
+      registration.buffer = std::make_shared<internal_async_log::ThreadBuffer>(
+          options_.buffer_size_per_thread);
+      absl::MutexLock lock(&mutex_);
+      buffers_.push_back(registration.buffer);
+    }
+    return registration.buffer.get();
+  }
+
+  void BackgroundThreadEntryPoint() {
+    bool stopping = false;
+    while (!stopping) {
+      stopping = stopping_notification_.WaitForNotificationWithTimeout(
+          options_.flush_interval);
+      DrainAll();
+    }
+  }
+
+  void DrainAll() {
+    std::vector<std::shared_ptr<internal_async_log::ThreadBuffer>> buffers;
+    {
+      absl::MutexLock lock(&mutex_);
+      buffers = buffers_;
+    }
+
+    // One chunk of formatted lines per buffer, written with one |writev()|.
+    std::vector<std::string> chunks(buffers.size());
+    std::vector<iovec> iov;
+    std::vector<const internal_async_log::ThreadBuffer*> done;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+      // Read |abandoned| first: the thread made its last commit before.
+      const bool abandoned =
+          buffers[i]->abandoned.load(std::memory_order_acquire);
+      buffers[i]->Drain(&chunks[i]);
+      if (!chunks[i].empty()) {
+        iov.push_back({chunks[i].data(), chunks[i].size()});
+      }
+      if (abandoned) {
+        done.push_back(buffers[i].get());
+      }
+    }
+    WriteAll(absl::MakeSpan(iov));
+
+    if (!done.empty()) {
+      absl::MutexLock lock(&mutex_);
+      buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                    [&](const auto& b) {
+                                      return absl::c_linear_search(done,
+                                                                   b.get());
+                                    }),
+                     buffers_.end());
+    }
+  }
+
+  void WriteAll(absl::Span<iovec> iov) {
+    while (!iov.empty()) {
+      const int count = static_cast<int>(std::min<size_t>(iov.size(), IOV_MAX));
+      ssize_t n = ::writev(options_.fd, iov.data(), count);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;  // Nowhere left to report the error.
+      }
+      // Skip what was written, possibly stopping in the middle of a chunk.
+      while (!iov.empty() && static_cast<size_t>(n) >= iov[0].iov_len) {
+        n -= iov[0].iov_len;
+        iov.remove_prefix(1);
+      }
+      if (!iov.empty()) {
+        iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + n;
+        iov[0].iov_len -= n;
+      }
+    }
+  }
+
+  // Unlike |this|, never reused by a later logger.
+  static inline std::atomic<uint64_t> next_id_{1};
+  const uint64_t id_ = next_id_.fetch_add(1);
+  const AsyncLoggerOptions options_;
+
+  absl::Mutex mutex_;
+  std::vector<std::shared_ptr<internal_async_log::ThreadBuffer>> buffers_
+      ABSL_GUARDED_BY(mutex_);
+
+  std::unique_ptr<std::thread> background_thread_;
+  absl::Notification stopping_notification_;
+};
+// --8<-- [end:code]
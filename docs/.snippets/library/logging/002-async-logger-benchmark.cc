@@ -0,0 +1,49 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Time spent in the calling thread per log line, and lines per second over
+// all threads. With |kDrop| the async logger shows the cost for the caller,
+// but lines the background thread could not keep up with are dropped, use
+// |kBlock| to compare the sustained throughput. Redirect the output, e.g.
+//   ./logging_benchmark --benchmark_counters_tabular=true 2>/tmp/log.txt
+void BM_SyncLog(benchmark::State& state) {
+  const std::string peer = "10.0.0.1:8080";
+  int64_t i = 0;
+  for (auto _ : state) {
+    LOG(INFO) << "Got " << ++i << " bytes from " << peer;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SyncLog)->ThreadRange(1, 32)->UseRealTime();
+
+void BM_AsyncLog(benchmark::State& state) {
+  // The other threads only use |logger| inside the loop, which starts after
+  // all threads reached it.
+  static AsyncLogger* logger;
+  if (state.thread_index() == 0) {
+    AsyncLoggerOptions options;
+    options.overflow_policy = state.range(0) == 0 ? OverflowPolicy::kDrop
+                                                  : OverflowPolicy::kBlock;
+    logger = new AsyncLogger(options);
+    logger->Start().IgnoreError();
+  }
+  const std::string peer = "10.0.0.1:8080";
+  int64_t i = 0;
+  for (auto _ : state) {
+    ASYNC_LOG(*logger, "Got %d bytes from %s", ++i, peer);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    logger->Stop();
+    delete logger;
+  }
+}
+BENCHMARK(BM_AsyncLog)
+    ->ArgName("block")
+    ->Arg(0)
+    ->Arg(1)
+    ->ThreadRange(1, 32)
+    ->UseRealTime();
+// --8<-- [end:code]
@@ -0,0 +1,310 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// A flat file of fixed-size records, read in place from an mmapped buffer:
+// no parsing on load and no allocation on access. The layout, with all
+// integers little-endian:
+//
+//   FlatFileHeader
+//   |record_count| records of |record_size| bytes, fields at fixed offsets
+//   the string table: the bytes of all strings, back to back
+//
+// A string field stores a |FlatString|, a range of the string table.
+//
+// The fields of a record type are listed in an X-macro, from which
+// |DEFINE_FLAT_RECORD| generates the read-only view, e.g.
+//
+//   #define POINT_FIELDS(FIELD) FIELD(int32_t, x, 0) FIELD(int32_t, y, 0)
+//   DEFINE_FLAT_RECORD(PointView, POINT_FIELDS);
+//
+// The offset of a field is the total size of the fields before it, so fields
+// are only ever appended, never removed, reordered or retyped. |record_size|
+// grows with every added field: an old reader skips the new fields, a new
+// reader returns the default value of a field the record is too short for.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "The fields are read with memcpy, in the native byte order");
+
+constexpr char kFlatFileMagic[8] = {'F', 'L', 'A', 'T', 'R', 'E', 'C', '1'};
+
+struct FlatFileHeader {
+  char magic[8];
+  uint64_t record_size;  // Bytes per record, as written.
+  uint64_t record_count;
+  uint64_t strings_size;
+};
+
+// The string table is at most 4 GiB.
+struct FlatString {
+  uint32_t offset;
+  uint32_t size;
+};
+
+namespace flat_internal {
+
+// How a field of type |T| is stored: scalars as they are, strings as a
+// |FlatString|.
+template <typename T>
+struct Stored {
+  static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>);
+  using type = T;
+};
+template <>
+struct Stored<absl::string_view> {
+  using type = FlatString;
+};
+
+template <typename T>
+constexpr size_t StoredSize() {
+  return sizeof(typename Stored<T>::type);
+}
+
+template <typename T>
+void EncodeField(T value, char* out, std::string* /*strings*/) {
+  std::memcpy(out, &value, sizeof(value));
+}
+
+inline void EncodeField(absl::string_view value, char* out,
+                        std::string* strings) {
+  const FlatString s{static_cast<uint32_t>(strings->size()),
+                     static_cast<uint32_t>(value.size())};
+  strings->append(value.data(), value.size());
+  std::memcpy(out, &s, sizeof(s));
+}
+
+// One record in the mapped file.
+class RecordRef {
+ public:
+  RecordRef(const char* data, size_t size, absl::string_view strings)
+      : data_(data), size_(size), strings_(strings) {}
+
+  // The memcpy compiles to a single load: the record needs no alignment.
+  template <typename T>
+  T Get(size_t offset, T default_value) const {
+    if (offset + StoredSize<T>() > size_) {
+      return default_value;  // Written before the field was added.
+    }
+    T value;
+    std::memcpy(&value, data_ + offset, sizeof(value));
+    return value;
+  }
+
+  absl::string_view Get(size_t offset, absl::string_view default_value) const {
+    if (offset + sizeof(FlatString) > size_) {
+      return default_value;
+    }
+    FlatString s;
+    std::memcpy(&s, data_ + offset, sizeof(s));
+    // A corrupt entry reads as empty instead of out of bounds.
+    if (s.offset > strings_.size() || s.size > strings_.size() - s.offset) {
+      return absl::string_view();
+    }
+    return strings_.substr(s.offset, s.size);
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  absl::string_view strings_;
+};
+
+// The offset of every field, then the record size.
+template <size_t N>
+constexpr std::array<size_t, N + 1> Offsets(const size_t (&sizes)[N]) {
+  std::array<size_t, N + 1> offsets{};
+  for (size_t i = 0; i < N; ++i) {
+    offsets[i + 1] = offsets[i] + sizes[i];
+  }
+  return offsets;
+}
+
+}  // namespace flat_internal
+
+#define FLAT_FIELD_INDEX_(type, name, default_value) k_##name,
+#define FLAT_FIELD_SIZE_(type, name, default_value) \
+  ::flat_internal::StoredSize<type>(),
+#define FLAT_FIELD_MEMBER_(type, name, default_value) \
+  type name = default_value;
+#define FLAT_FIELD_GETTER_(type, name, default_value)            \
+  type name() const {                                            \
+    return record_.Get(kOffsets[k_##name], type(default_value)); \
+  }
+#define FLAT_FIELD_ENCODE_(type, name, default_value) \
+  ::flat_internal::EncodeField(record.name, out + kOffsets[k_##name], strings);
+
+#define DEFINE_FLAT_RECORD(ViewName, FIELDS)                                 \
+  class ViewName {                                                           \
+   public:                                                                   \
+    /* What the writer takes: strings must outlive |FlatWriter::Add()|. */   \
+    struct Record {                                                          \
+      FIELDS(FLAT_FIELD_MEMBER_)                                             \
+    };                                                                       \
+                                                                             \
+    explicit ViewName(::flat_internal::RecordRef record)                     \
+        : record_(record) {}                                                 \
+                                                                             \
+    FIELDS(FLAT_FIELD_GETTER_)                                               \
+                                                                             \
+   private:                                                                  \
+    template <typename View>                                                 \
+    friend class FlatWriter;                                                 \
+                                                                             \
+    enum Field { FIELDS(FLAT_FIELD_INDEX_) kFieldCount };                    \
+    static constexpr size_t kSizes[] = {FIELDS(FLAT_FIELD_SIZE_)};           \
+    static constexpr auto kOffsets = ::flat_internal::Offsets(kSizes);       \
+    static constexpr size_t kRecordSize = kOffsets[kFieldCount];             \
+                                                                             \
+    static void Encode(const Record& record, char* out,                      \
+                       std::string* strings) {                               \
+      FIELDS(FLAT_FIELD_ENCODE_)                                             \
+    }                                                                        \
+                                                                             \
+    ::flat_internal::RecordRef record_;                                      \
+  }
+
+// Read-only records of type |View|, mapped from a file.
+template <typename View>
+class FlatFile {
+ public:
+  static absl::StatusOr<FlatFile> Open(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return IOError(filename, errno);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      const int error = errno;
+      ::close(fd);
+      return IOError(filename, error);
+    }
+    const size_t size = st.st_size;
+    void* data = size > 0 ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0)
+                          : MAP_FAILED;
+    const int error = errno;
+    ::close(fd);  // The mapping keeps the file open.
+    if (data == MAP_FAILED) {
+      return size > 0 ? IOError(filename, error)
+                      : absl::DataLossError(filename + ": empty file");
+    }
+    FlatFile file(static_cast<const char*>(data), size);
+    absl::Status status = file.Validate();
+    if (!status.ok()) {
+      return absl::DataLossError(
+          absl::StrCat(filename, ": ", status.message()));
+    }
+    return file;
+  }
+
+  FlatFile(FlatFile&& other)
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)),
+        header_(other.header_) {}
+  FlatFile& operator=(FlatFile&&) = delete;
+
+  ~FlatFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  size_t size() const { return header_.record_count; }
+
+  View operator[](size_t i) const {
+    return View(flat_internal::RecordRef(
+        data_ + sizeof(FlatFileHeader) + i * header_.record_size,
+        header_.record_size, strings()));
+  }
+
+ private:
+  FlatFile(const char* data, size_t size) : data_(data), size_(size) {}
+
+  // Checks the header and the total size only, O(1): the records themselves
+  // are not touched until they are read.
+  absl::Status Validate() {
+    if (size_ < sizeof(FlatFileHeader)) {
+      return absl::DataLossError("truncated header");
+    }
+    std::memcpy(&header_, data_, sizeof(header_));
+    if (std::memcmp(header_.magic, kFlatFileMagic, sizeof(kFlatFileMagic)) !=
+        0) {
+      return absl::DataLossError("not a flat record file");
+    }
+    const size_t available = size_ - sizeof(FlatFileHeader);
+    if (header_.record_size != 0 &&
+        header_.record_count > available / header_.record_size) {
+      return absl::DataLossError("truncated records");
+    }
+    if (header_.strings_size !=
+        available - header_.record_count * header_.record_size) {
+      return absl::DataLossError("bad string table size");
+    }
+    return absl::OkStatus();
+  }
+
+  absl::string_view strings() const {
+    return absl::string_view(data_ + size_ - header_.strings_size,
+                             header_.strings_size);
+  }
+
+  const char* data_;
+  size_t size_;
+  FlatFileHeader header_;
+};
+
+template <typename View>
+class FlatWriter {
+ public:
+  void Add(const typename View::Record& record) {
+    const size_t offset = records_.size();
+    records_.resize(offset + View::kRecordSize);
+    View::Encode(record, records_.data() + offset, &strings_);
+    ++record_count_;
+  }
+
+  absl::Status WriteTo(const std::string& filename) const {
+    if (strings_.size() > std::numeric_limits<uint32_t>::max()) {
+      return absl::ResourceExhaustedError("string table over 4 GiB");
+    }
+    FlatFileHeader header;
+    std::memcpy(header.magic, kFlatFileMagic, sizeof(kFlatFileMagic));
+    header.record_size = View::kRecordSize;
+    header.record_count = record_count_;
+    header.strings_size = strings_.size();
+
+    const int fd = ::open(filename.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return IOError(filename, errno);
+    }
+    for (absl::string_view part :
+         {absl::string_view(reinterpret_cast<const char*>(&header),
+                            sizeof(header)),
+          absl::string_view(records_), absl::string_view(strings_)}) {
+      while (!part.empty()) {
+        const ssize_t n = ::write(fd, part.data(), part.size());
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n < 0) {
+          const int error = errno;
+          ::close(fd);
+          return IOError(filename, error);
+        }
+        part.remove_prefix(n);
+      }
+    }
+    if (::close(fd) != 0) {
+      return IOError(filename, errno);
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  std::string records_;
+  std::string strings_;
+  uint64_t record_count_ = 0;
+};
+// --8<-- [end:code]
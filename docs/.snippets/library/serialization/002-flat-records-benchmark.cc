@@ -0,0 +1,141 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// |ValueType| from the Types chapter: { int32_t id; std::string name; }.
+#define VALUE_TYPE_FIELDS(FIELD) \
+  FIELD(int32_t, id, 0)          \
+  FIELD(absl::string_view, name, "")
+DEFINE_FLAT_RECORD(ValueTypeView, VALUE_TYPE_FIELDS);
+
+// |Person| from the Types chapter, with the usual |name()| and |age()|
+// getters. |email| was added later: it reads as "" from older files, and
+// older readers skip it.
+#define PERSON_FIELDS(FIELD)          \
+  FIELD(absl::string_view, name, "")  \
+  FIELD(int32_t, age, -1)             \
+  FIELD(absl::string_view, email, "")
+DEFINE_FLAT_RECORD(PersonView, PERSON_FIELDS);
+
+absl::Status WritePeople(const std::vector<Person>& people,
+                         const std::string& filename) {
+  FlatWriter<PersonView> writer;
+  for (const Person& p : people) {
+    writer.Add({.name = p.name(), .age = p.age()});
+  }
+  return writer.WriteTo(filename);
+}
+
+// The baseline: a length-prefixed binary format which is parsed into
+// |ValueType| objects on load, the way a repeated protobuf message is.
+absl::Status WriteLengthPrefixed(const std::vector<ValueType>& values,
+                                 const std::string& filename) {
+  std::string buffer;
+  for (const ValueType& v : values) {
+    const uint32_t size = v.name.size();
+    buffer.append(reinterpret_cast<const char*>(&v.id), sizeof(v.id));
+    buffer.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    buffer.append(v.name);
+  }
+  std::ofstream out(filename, std::ios::binary);
+  out.write(buffer.data(), buffer.size());
+  return out.good() ? absl::OkStatus() : IOError(filename, errno);
+}
+
+absl::StatusOr<std::vector<ValueType>> ParseLengthPrefixed(
+    const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  const std::string buffer((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  std::vector<ValueType> values;
+  absl::string_view rest = buffer;
+  while (!rest.empty()) {
+    int32_t id;
+    uint32_t size;
+    if (rest.size() < sizeof(id) + sizeof(size)) {
+      return absl::DataLossError(filename + ": truncated record");
+    }
+    std::memcpy(&id, rest.data(), sizeof(id));
+    std::memcpy(&size, rest.data() + sizeof(id), sizeof(size));
+    rest.remove_prefix(sizeof(id) + sizeof(size));
+    if (rest.size() < size) {
+      return absl::DataLossError(filename + ": truncated name");
+    }
+    values.push_back(ValueType{id, std::string(rest.substr(0, size))});
+    rest.remove_prefix(size);
+  }
+  return values;
+}
+
+constexpr int kRecordCount = 10'000'000;
+constexpr int kLookups = 10'000'000;
+
+// Names are longer than the small string buffer: every parsed |ValueType|
+// allocates.
+std::vector<ValueType> MakeValues() {
+  std::vector<ValueType> values(kRecordCount);
+  for (int i = 0; i < kRecordCount; ++i) {
+    values[i] = ValueType{i, absl::StrCat("value-type-name-", i)};
+  }
+  return values;
+}
+
+// Sums the fields of random records, so that every lookup misses the cache.
+template <typename Records, typename Read>
+void TimeRandomAccess(absl::string_view name, const Records& records,
+                      Read read) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> index(0, records.size() - 1);
+  std::vector<size_t> indexes(kLookups);
+  for (size_t& i : indexes) {
+    i = index(gen);
+  }
+  const absl::Time start = absl::Now();
+  int64_t sum = 0;
+  for (size_t i : indexes) {
+    sum += read(records[i]);
+  }
+  const absl::Duration elapsed = absl::Now() - start;
+  absl::PrintF("%s: %.1f ns per random access (checksum %d)\n", name,
+               absl::ToDoubleNanoseconds(elapsed / kLookups), sum);
+}
+
+void CompareFlatWithParsing(const std::string& dir) {
+  const std::string flat_file = dir + "/values.flat";
+  const std::string parsed_file = dir + "/values.bin";
+  {
+    const std::vector<ValueType> values = MakeValues();
+    FlatWriter<ValueTypeView> writer;
+    for (const ValueType& v : values) {
+      writer.Add({.id = v.id, .name = v.name});
+    }
+    CHECK_OK(writer.WriteTo(flat_file));
+    CHECK_OK(WriteLengthPrefixed(values, parsed_file));
+  }
+
+  // The files are in the page cache: the load times do not include the disk.
+  absl::Time start = absl::Now();
+  absl::StatusOr<FlatFile<ValueTypeView>> flat =
+      FlatFile<ValueTypeView>::Open(flat_file);
+  CHECK_OK(flat.status());
+  absl::PrintF("Flat: loaded %d records in %s\n", flat->size(),
+               absl::FormatDuration(absl::Now() - start));
+
+  start = absl::Now();
+  absl::StatusOr<std::vector<ValueType>> parsed =
+      ParseLengthPrefixed(parsed_file);
+  CHECK_OK(parsed.status());
+  absl::PrintF("Parsed: loaded %d records in %s\n", parsed->size(),
+               absl::FormatDuration(absl::Now() - start));
+
+  // The first pass over the flat file also maps its pages in.
+  for (int pass = 1; pass <= 2; ++pass) {
+    TimeRandomAccess(absl::StrCat("Flat, pass ", pass), *flat,
+                     [](ValueTypeView v) { return v.id() + v.name().size(); });
+  }
+  TimeRandomAccess("Parsed", *parsed, [](const ValueType& v) {
+    return v.id + v.name.size();
+  });
+}
+// --8<-- [end:code]
@@ -0,0 +1,232 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// example/example_benchmark.cc
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "example/example_lib.h"
+
+namespace example {
+namespace {
+
+// Registers working sets of half of every data cache level, plus one of twice
+// the last level cache, so that each benchmark shows where it falls out of a
+// cache. |kBytesPerElement| is the memory one element takes, including the
+// overhead of the container.
+template <int64_t kBytesPerElement>
+void CacheSizedArgs(benchmark::internal::Benchmark* b) {
+  std::vector<int64_t> cache_bytes;
+  for (const auto& cache : benchmark::CPUInfo::Get().caches) {
+    if (cache.type != "Instruction") {
+      cache_bytes.push_back(cache.size);
+    }
+  }
+  if (cache_bytes.empty()) {
+    cache_bytes = {32 << 10, 1 << 20, 32 << 20};  // Typical for a server.
+  }
+  std::sort(cache_bytes.begin(), cache_bytes.end());
+  for (int64_t bytes : cache_bytes) {
+    b->Arg(bytes / 2 / kBytesPerElement);
+  }
+  b->Arg(cache_bytes.back() * 2 / kBytesPerElement);
+}
+
+// Fixed seeds: every run measures the same inputs.
+std::vector<int> RandomInts(int64_t n, int max) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> distrib(0, max);
+  std::vector<int> v(n);
+  for (int& i : v) {
+    i = distrib(gen);
+  }
+  return v;
+}
+
+void BM_ReadFeature(benchmark::State& state) {
+  const int64_t n = state.range(0);
+  std::string data(sizeof(int64_t) + n * sizeof(int32_t), '\0');
+  std::memcpy(data.data(), &n, sizeof(n));
+  for (auto _ : state) {
+    ByteBuffer buffer(data);
+    std::vector<int32_t> feature;
+    benchmark::DoNotOptimize(ReadFeature(&buffer, &feature));
+    benchmark::DoNotOptimize(feature.data());
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_ReadFeature)->Apply(CacheSizedArgs<sizeof(int32_t)>);
+
+// No readers hold a snapshot, so |Push()| never copies.
+void BM_MyQueuePush(benchmark::State& state) {
+  MyQueue queue;
+  int i = 0;
+  for (auto _ : state) {
+    queue.Push(i++);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MyQueuePush);
+
+// Sends stdout to /dev/null while alive, so that the benchmark measures
+// formatting, not the terminal.
+class ScopedStdoutToDevNull {
+ public:
+  ScopedStdoutToDevNull() : saved_stdout_(::dup(STDOUT_FILENO)) {
+    std::fflush(stdout);
+    const int dev_null = ::open("/dev/null", O_WRONLY);
+    ::dup2(dev_null, STDOUT_FILENO);
+    ::close(dev_null);
+  }
+  ~ScopedStdoutToDevNull() {
+    std::fflush(stdout);
+    ::dup2(saved_stdout_, STDOUT_FILENO);
+    ::close(saved_stdout_);
+  }
+
+ private:
+  const int saved_stdout_;
+};
+
+void BM_MyQueuePrint(benchmark::State& state) {
+  MyQueue queue;
+  for (int i = 0; i < state.range(0); ++i) {
+    queue.Push(i);
+  }
+  ScopedStdoutToDevNull silence;
+  for (auto _ : state) {
+    queue.Print();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MyQueuePrint)->Apply(CacheSizedArgs<sizeof(int)>);
+
+// Half of the lookups miss. There are as many random keys as entries, so
+// that the lookups touch the whole map. An entry takes about 48 bytes: a 32
+// byte node plus its share of the buckets.
+template <typename Lookup>
+void LookUpRandomKeys(benchmark::State& state, Lookup lookup) {
+  const int64_t n = state.range(0);
+  std::unordered_map<int, int> map;
+  for (int i = 0; i < n; ++i) {
+    map[i] = i;
+  }
+  const std::vector<int> keys = RandomInts(n, 2 * n - 1);
+  size_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lookup(map, keys[next++ % keys.size()]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_UnorderedMapContains(benchmark::State& state) {
+  LookUpRandomKeys(state, [](const std::unordered_map<int, int>& map,
+                             int key) { return Contains(map, key); });
+}
+BENCHMARK(BM_UnorderedMapContains)->Apply(CacheSizedArgs<48>);
+
+void BM_UnorderedMapFind(benchmark::State& state) {
+  LookUpRandomKeys(state, [](const std::unordered_map<int, int>& map,
+                             int key) { return F(map, key); });
+}
+BENCHMARK(BM_UnorderedMapFind)->Apply(CacheSizedArgs<48>);
+
+bool IsOdd(int i) { return i % 2 != 0; }
+
+// Random values: the branch in |IsOdd()| is unpredictable.
+void BM_EraseRemove(benchmark::State& state) {
+  const std::vector<int> input = RandomInts(state.range(0), 9);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<int> v = input;
+    state.ResumeTiming();
+    v.erase(std::remove_if(v.begin(), v.end(), IsOdd), v.end());
+    benchmark::DoNotOptimize(v.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EraseRemove)->Apply(CacheSizedArgs<sizeof(int)>);
+
+void BM_RandomFill(benchmark::State& state) {
+  const int n = state.range(0);
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> distrib(1, 6);
+  for (auto _ : state) {
+    std::vector<int> values;
+    std::vector<int>* v = &values;
+    v->reserve(n);
+    for (int i = 0; i < n; i++) {
+      v->emplace_back(distrib(gen));
+    }
+    benchmark::DoNotOptimize(values.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_RandomFill)->Apply(CacheSizedArgs<sizeof(int)>);
+
+// The target is missing: |Contains()| scans the whole string.
+void BM_StringContains(benchmark::State& state) {
+  const std::string str(state.range(0), 'a');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Contains(str, 'b'));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_StringContains)->Apply(CacheSizedArgs<1>);
+
+// Short names stay in the small string buffer: a |Record| is 48 bytes.
+std::vector<Record> RandomRecords(int64_t n) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<unsigned int> floor(0, 99);
+  std::uniform_real_distribution<double> weight(0.0, 100.0);
+  std::vector<Record> records(n);
+  for (Record& r : records) {
+    r.name = "room-" + std::to_string(gen() % 1000);
+    r.floor = floor(gen);
+    r.weight = weight(gen);
+  }
+  return records;
+}
+
+template <typename Sort>
+void SortRandomRecords(benchmark::State& state, Sort sort) {
+  const std::vector<Record> input = RandomRecords(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Record> records = input;
+    state.ResumeTiming();
+    sort(&records);
+    benchmark::DoNotOptimize(records.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_SortRecords(benchmark::State& state) {
+  SortRandomRecords(state, [](std::vector<Record>* records) {
+    std::sort(records->begin(), records->end());
+  });
+}
+BENCHMARK(BM_SortRecords)->Apply(CacheSizedArgs<sizeof(Record)>);
+
+void BM_SortRecordsByNormalizedKey(benchmark::State& state) {
+  SortRandomRecords(state, [](std::vector<Record>* records) {
+    SortByNormalizedKey(records);
+  });
+}
+BENCHMARK(BM_SortRecordsByNormalizedKey)
+    ->Apply(CacheSizedArgs<sizeof(Record)>);
+
+}  // namespace
+}  // namespace example
+// --8<-- [end:code]
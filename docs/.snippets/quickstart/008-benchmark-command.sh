@@ -0,0 +1,16 @@
+# SPDX-FileCopyrightText: 2021 Shuai Zhang
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# --8<-- [start:code]
+# Record a baseline on the unchanged code.
+bazel run -c opt //example:example_benchmark -- \
+  --benchmark_repetitions=10 \
+  --benchmark_enable_random_interleaving=true \
+  --benchmark_report_aggregates_only=true \
+  --benchmark_out="${PWD}/baseline.json" --benchmark_out_format=json
+
+# Apply the change, run the same command with
+# --benchmark_out="${PWD}/candidate.json", then compare.
+python3 tools/compare_benchmarks.py baseline.json candidate.json
+# --8<-- [end:code]
@@ -0,0 +1,67 @@
+# SPDX-FileCopyrightText: 2021 Shuai Zhang
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# --8<-- [start:code]
+# tools/compare_benchmarks.py
+"""Compares two Google Benchmark JSON files, exits with 1 on regressions.
+
+Both runs need --benchmark_repetitions, the comparison uses the medians. A
+change only counts if it is larger than the threshold and than twice the
+noise (coefficient of variation) of either run.
+"""
+
+import argparse
+import json
+import sys
+
+_NANOSECONDS = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    """Returns {name: (median cpu_time in ns, cv)}."""
+    with open(path) as f:
+        benchmarks = json.load(f)["benchmarks"]
+    medians, cvs = {}, {}
+    for b in benchmarks:
+        if b.get("run_type") != "aggregate":
+            continue
+        if b["aggregate_name"] == "median":
+            scale = _NANOSECONDS[b["time_unit"]]
+            medians[b["run_name"]] = b["cpu_time"] * scale
+        elif b["aggregate_name"] == "cv":
+            cvs[b["run_name"]] = b["cpu_time"]
+    return {name: (t, cvs.get(name, 0.0)) for name, t in medians.items()}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative change to report, default 5%%")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    candidate = load(args.candidate)
+    regressions = 0
+    print(f"{'benchmark':<50} {'baseline':>12} {'candidate':>12} "
+          f"{'change':>8}")
+    for name in sorted(baseline.keys() & candidate.keys()):
+        (old, old_cv), (new, new_cv) = baseline[name], candidate[name]
+        change = new / old - 1
+        noise = 2 * max(old_cv, new_cv)
+        verdict = ""
+        if abs(change) > max(args.threshold, noise):
+            verdict = "SLOWER" if change > 0 else "faster"
+            regressions += change > 0
+        print(f"{name:<50} {old:>10.0f}ns {new:>10.0f}ns {change:>+8.1%} "
+              f"{verdict}")
+    for name in sorted(baseline.keys() ^ candidate.keys()):
+        print(f"{name:<50} only in one of the files")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
+# --8<-- [end:code]
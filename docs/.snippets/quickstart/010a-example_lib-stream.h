@@ -0,0 +1,33 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// example/example_lib.h
+#pragma once
+
+#include <cstdint>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace example {
+
+int sum(int a, int b);
+
+// Overflow wraps around, like unsigned arithmetic.
+int64_t sum(absl::Span<const int64_t> values);
+
+// Sums the decimal integers in |text|, separated by any other characters,
+// with |num_threads| threads.
+int64_t SumIntegers(absl::string_view text, int num_threads);
+
+// Sums the integers in the file |fd|, e.g. stdin. Regular files are mapped
+// into memory, pipes are read in large blocks.
+absl::StatusOr<int64_t> SumIntegersInFile(int fd, int num_threads);
+
+}  // namespace example
+// --8<-- [end:code]
@@ -0,0 +1,222 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// example/example_lib.cc
+#include "example/example_lib.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+
+namespace example {
+namespace {
+
+constexpr uint64_t kAsciiZeros = 0x3030303030303030;
+
+constexpr uint64_t kPowersOf10[] = {1,      10,      100,      1000,     10000,
+                                    100000, 1000000, 10000000, 100000000};
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// A byte which may belong to the same number as the next one.
+bool IsNumberChar(char c) { return IsDigit(c) || c == '-'; }
+
+uint64_t Load8(const char* p) {
+  uint64_t chunk;
+  std::memcpy(&chunk, p, sizeof(chunk));
+  return chunk;
+}
+
+// SWAR (SIMD within a register): works on 8 characters at once, loaded into
+// a little-endian |chunk|. Returns the number of leading digits.
+int CountDigits(uint64_t chunk) {
+  // A byte is a digit if its high nibble is 3 before and after adding 6.
+  // Only a non-digit byte can carry into the next one, which does not count
+  // any more.
+  constexpr uint64_t kHighNibbles = 0xF0F0F0F0F0F0F0F0;
+  const uint64_t x =
+      ((chunk & kHighNibbles) ^ kAsciiZeros) |
+      (((chunk + 0x0606060606060606) & kHighNibbles) ^ kAsciiZeros);
+  // 0x80 in each byte of |x| which is not 0, i.e. not a digit.
+  const uint64_t non_digits =
+      (((x & 0x7F7F7F7F7F7F7F7F) + 0x7F7F7F7F7F7F7F7F) | x) &
+      0x8080808080808080;
+  return non_digits == 0 ? 8 : absl::countr_zero(non_digits) / 8;
+}
+
+// Returns the value of the first |n| (1 to 8) digits of |chunk| with three
+// multiplications instead of |n|.
+uint64_t ParseDigits(uint64_t chunk, int n) {
+  // Shift the digits to the top, the bytes shifted in become leading zeros.
+  uint64_t v = (chunk - kAsciiZeros) << (8 * (8 - n));
+  // Combine neighbours into 2-digit, then 4-digit, then 8-digit values.
+  v = v * 10 + (v >> 8);
+  return ((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32)) +
+          ((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32))) >>
+         32;
+}
+
+// Sums the integers in [p, end). Reads 8 bytes at a time while at least 8 are
+// left, then one by one.
+uint64_t SumRange(const char* p, const char* end) {
+  constexpr size_t kBatchSize = 1024;
+  int64_t batch[kBatchSize];
+  size_t batch_size = 0;
+  uint64_t total = 0;
+  while (p < end) {
+    if (!IsNumberChar(*p)) {
+      ++p;
+      continue;
+    }
+    const bool negative = *p == '-';
+    if (negative && (++p == end || !IsDigit(*p))) {
+      continue;
+    }
+    uint64_t value = 0;
+    while (end - p >= 8) {
+      const uint64_t chunk = Load8(p);
+      const int n = CountDigits(chunk);
+      if (n == 0) {
+        break;
+      }
+      value = value * kPowersOf10[n] + ParseDigits(chunk, n);
+      p += n;
+      if (n < 8) {
+        break;
+      }
+    }
+    for (; p < end && IsDigit(*p); ++p) {
+      value = value * 10 + (*p - '0');
+    }
+    batch[batch_size++] = static_cast<int64_t>(negative ? 0 - value : value);
+    if (batch_size == kBatchSize) {
+      total += static_cast<uint64_t>(sum(absl::MakeConstSpan(batch)));
+      batch_size = 0;
+    }
+  }
+  return total + static_cast<uint64_t>(
+                     sum(absl::MakeConstSpan(batch, batch_size)));
+}
+
+}  // namespace
+
+int sum(int a, int b) { return a + b; }
+
+int64_t sum(absl::Span<const int64_t> values) {
+  // Independent accumulators: no add waits for the previous one, and the
+  // compiler turns them into SIMD adds. Indexes the raw pointer, because the
+  // bounds checks of |Span::operator[]| in hardened builds prevent that.
+  const int64_t* data = values.data();
+  const size_t size = values.size();
+  uint64_t partial[4] = {};
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    for (int j = 0; j < 4; ++j) {
+      partial[j] += static_cast<uint64_t>(data[i + j]);
+    }
+  }
+  for (; i < size; ++i) {
+    partial[0] += static_cast<uint64_t>(data[i]);
+  }
+  return static_cast<int64_t>(partial[0] + partial[1] + partial[2] +
+                              partial[3]);
+}
+
+int64_t SumIntegers(absl::string_view text, int num_threads) {
+  num_threads = std::max(num_threads, 1);
+  // Move every boundary past the number it would cut in two.
+  std::vector<size_t> bounds = {0};
+  for (int i = 1; i < num_threads; ++i) {
+    size_t bound = std::max(bounds.back(), text.size() * i / num_threads);
+    while (bound > 0 && bound < text.size() && IsNumberChar(text[bound - 1])) {
+      ++bound;
+    }
+    bounds.push_back(bound);
+  }
+  bounds.push_back(text.size());
+
+  std::vector<uint64_t> totals(num_threads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      totals[i] =
+          SumRange(text.data() + bounds[i], text.data() + bounds[i + 1]);
+    });
+  }
+  uint64_t total = 0;
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i].join();
+    total += totals[i];
+  }
+  return static_cast<int64_t>(total);
+}
+
+absl::StatusOr<int64_t> SumIntegersInFile(int fd, int num_threads) {
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    return absl::ErrnoToStatus(errno, "fstat");
+  }
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    // No copy into a buffer: the threads parse the page cache directly.
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      return absl::ErrnoToStatus(errno, "mmap");
+    }
+    ::madvise(data, st.st_size, MADV_SEQUENTIAL);
+    const int64_t total = SumIntegers(
+        absl::string_view(static_cast<const char*>(data), st.st_size),
+        num_threads);
+    ::munmap(data, st.st_size);
+    return total;
+  }
+
+  // Pipes cannot be mapped. Fill a large block, sum the complete numbers in
+  // it, and carry the one cut at its end over to the next block.
+  constexpr size_t kBlockSize = 64 << 20;
+  std::string block(kBlockSize, '\0');
+  size_t size = 0;
+  uint64_t total = 0;
+  bool eof = false;
+  while (!eof) {
+    while (size < block.size()) {
+      const ssize_t n = ::read(fd, block.data() + size, block.size() - size);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        return absl::ErrnoToStatus(errno, "read");
+      }
+      if (n == 0) {
+        eof = true;
+        break;
+      }
+      size += n;
+    }
+    size_t complete = size;
+    while (!eof && complete > 0 && IsNumberChar(block[complete - 1])) {
+      --complete;
+    }
+    if (complete == 0 && !eof) {
+      return absl::InvalidArgumentError("Number longer than a block.");
+    }
+    total += static_cast<uint64_t>(
+        SumIntegers(absl::string_view(block.data(), complete), num_threads));
+    std::memmove(block.data(), block.data() + complete, size - complete);
+    size -= complete;
+  }
+  return static_cast<int64_t>(total);
+}
+
+}  // namespace example
+// --8<-- [end:code]
@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// example/main.cc
+#include <unistd.h>
+
+#include <iostream>
+#include <thread>
+
+#include "absl/strings/string_view.h"
+#include "example/example_lib.h"
+
+int main(int argc, char** argv) {
+  // Sums all integers on stdin, e.g. |example --stream < numbers.txt|.
+  if (argc > 1 && absl::string_view(argv[1]) == "--stream") {
+    absl::StatusOr<int64_t> total = example::SumIntegersInFile(
+        STDIN_FILENO, std::thread::hardware_concurrency());
+    if (!total.ok()) {
+      std::cerr << total.status() << std::endl;
+      return 1;
+    }
+    std::cout << *total << std::endl;
+    return 0;
+  }
+
+  int a;
+  int b;
+  std::cin >> a >> b;
+  std::cout << example::sum(a, b) << std::endl;
+  return 0;
+}
+// --8<-- [end:code]
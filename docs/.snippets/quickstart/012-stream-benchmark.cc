@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// example/example_benchmark.cc, continued. Also needs <sstream> and <thread>.
+
+// 256 MiB of random integers with up to 10 digits, one per line.
+const std::string& IntegerText() {
+  static const std::string* text = [] {
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<int64_t> value(-9999999999, 9999999999);
+    auto* text = new std::string;
+    while (text->size() < (256 << 20)) {
+      text->append(std::to_string(value(gen))).push_back('\n');
+    }
+    return text;
+  }();
+  return *text;
+}
+
+// What |std::cin >>| does, but from memory like the others.
+void BM_SumIntegersIstream(benchmark::State& state) {
+  for (auto _ : state) {
+    std::istringstream in(IntegerText());
+    int64_t total = 0;
+    int64_t value;
+    while (in >> value) {
+      total += value;
+    }
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetBytesProcessed(state.iterations() * IntegerText().size());
+}
+BENCHMARK(BM_SumIntegersIstream)->Unit(benchmark::kMillisecond);
+
+void BM_SumIntegers(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(SumIntegers(IntegerText(), state.range(0)));
+  }
+  state.SetBytesProcessed(state.iterations() * IntegerText().size());
+}
+BENCHMARK(BM_SumIntegers)
+    ->Arg(1)
+    ->Arg(std::thread::hardware_concurrency())
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+// --8<-- [end:code]
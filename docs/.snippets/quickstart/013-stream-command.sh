@@ -0,0 +1,15 @@
+# SPDX-FileCopyrightText: 2021 Shuai Zhang
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# --8<-- [start:code]
+bazel build -c opt //example:example
+
+# About 1 GiB: 100M random integers, one per line.
+shuf -r -i 0-9999999999 -n 100000000 > numbers.txt
+
+# Regular file: mapped into memory.
+time bazel-bin/example/example --stream < numbers.txt
+# Pipe: read in 64 MiB blocks.
+time cat numbers.txt | bazel-bin/example/example --stream
+# --8<-- [end:code]
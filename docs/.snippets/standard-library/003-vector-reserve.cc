@@ -9,7 +9,7 @@ absl::Status ReadFeature(ByteBuffer* buffer, std::vector<int32_t>* feature) {
   if (value_count < 0) {
     return absl::DataLossError("Negative value count");
   }
-  if (value_count > static_cast<int64_t>(std::numeric_limits<size_t>::max())) {
+  if (static_cast<uint64_t>(value_count) > std::numeric_limits<size_t>::max()) {
     return absl::DataLossError("Too large value count");
   }
 
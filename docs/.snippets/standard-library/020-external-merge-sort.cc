@@ -0,0 +1,383 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Sorts a file of |Record|s far larger than memory:
+//
+// 1. Read the input into runs of at most |memory_budget / (num_threads + 1)|
+//    bytes, sort each run with |operator<| on a worker and spill it to a
+//    temporary file, up to |num_threads| runs at a time.
+// 2. Merge the runs with a loser tree. Every run reader prefetches its next
+//    block while the current one is consumed, and the writer flushes one
+//    block while the next one is filled (double buffering). If there are more
+//    runs than fit in memory, merge them in several passes.
+//
+// Files use a simple format: every record is a 4-byte length followed by the
+// payload written by |SerializeRecord()|.
+struct ExternalSortOptions {
+  std::string temp_dir = "/tmp";
+  size_t memory_budget = size_t{1} << 30;
+  int num_threads = 4;
+  size_t block_size = size_t{4} << 20;
+};
+
+// |Record| has the total-order operators defined through |cmp()| as above.
+void SerializeRecord(const Record& record, std::string* out);
+bool ParseRecord(absl::string_view payload, Record* record);
+
+absl::StatusOr<File> CreateTempFile(const std::string& dir) {
+  std::string path = dir + "/external-sort-XXXXXX";
+  const int fd = ::mkstemp(path.data());
+  if (fd < 0) {
+    return IOError(path, errno);
+  }
+  // Removed from the directory now, deleted by the OS when |File| closes it.
+  ::unlink(path.c_str());
+  return File(fd);
+}
+
+// Reads records from |file|, prefetching the next block asynchronously.
+class RunReader {
+ public:
+  RunReader(File file, size_t block_size)
+      : file_(std::move(file)), block_size_(block_size) {
+    next_block_ = std::async(std::launch::async, &RunReader::ReadBlock, this);
+  }
+
+  // The prefetch holds |this|, disallow copy and move.
+  RunReader(const RunReader&) = delete;
+  RunReader& operator=(const RunReader&) = delete;
+
+  // Returns false at the end of the file. A record cut short by the end of
+  // the file is an error, not the end.
+  absl::StatusOr<bool> Next(Record* record) {
+    while (true) {
+      const absl::string_view available =
+          absl::string_view(buffer_).substr(position_);
+      uint32_t size;
+      if (available.size() >= sizeof(size)) {
+        std::memcpy(&size, available.data(), sizeof(size));
+        if (available.size() >= sizeof(size) + size) {
+          if (!ParseRecord(available.substr(sizeof(size), size), record)) {
+            return absl::DataLossError("Corrupted record.");
+          }
+          position_ += sizeof(size) + size;
+          return true;
+        }
+      }
+
+      absl::StatusOr<std::string> block = next_block_.get();
+      if (!block.ok()) {
+        return block.status();
+      }
+      if (block->empty()) {
+        if (position_ < buffer_.size()) {
+          return absl::DataLossError("Truncated record at the end of file.");
+        }
+        return false;
+      }
+      buffer_.erase(0, position_);
+      position_ = 0;
+      buffer_.append(*block);
+      next_block_ =
+          std::async(std::launch::async, &RunReader::ReadBlock, this);
+    }
+  }
+
+ private:
+  // Only one block is read at a time, |offset_| needs no lock.
+  absl::StatusOr<std::string> ReadBlock() {
+    std::string block(block_size_, '\0');
+    const ssize_t n = ::pread(file_.fd(), block.data(), block.size(), offset_);
+    if (n < 0) {
+      return IOError("run file", errno);
+    }
+    offset_ += n;
+    block.resize(n);
+    return block;
+  }
+
+  File file_;
+  const size_t block_size_;
+  off_t offset_{0};
+  std::string buffer_;
+  size_t position_{0};
+  std::future<absl::StatusOr<std::string>> next_block_;
+};
+
+// Writes records to |file|, flushing full blocks asynchronously.
+class RunWriter {
+ public:
+  RunWriter(File file, size_t block_size)
+      : file_(std::move(file)), block_size_(block_size) {}
+
+  absl::Status Append(const Record& record) {
+    const size_t header = buffer_.size();
+    buffer_.append(sizeof(uint32_t), '\0');
+    SerializeRecord(record, &buffer_);
+    const auto size =
+        static_cast<uint32_t>(buffer_.size() - header - sizeof(uint32_t));
+    std::memcpy(&buffer_[header], &size, sizeof(size));
+    return buffer_.size() >= block_size_ ? Flush() : absl::OkStatus();
+  }
+
+  // Writes the remaining data and returns the file, ready to be read again.
+  absl::StatusOr<File> Finish() {
+    absl::Status s = Flush();
+    if (s.ok() && pending_write_.valid()) {
+      s = pending_write_.get();
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    return std::move(file_);
+  }
+
+ private:
+  absl::Status Flush() {
+    if (pending_write_.valid()) {
+      absl::Status s = pending_write_.get();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    pending_write_ = std::async(std::launch::async,
+                                [this, block = std::move(buffer_)]() {
+                                  return WriteBlock(block);
+                                });
+    buffer_ = std::string();
+    buffer_.reserve(block_size_);
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteBlock(absl::string_view block) {
+    while (!block.empty()) {
+      const ssize_t n = ::write(file_.fd(), block.data(), block.size());
+      if (n < 0) {
+        return IOError("run file", errno);
+      }
+      block.remove_prefix(n);
+    }
+    return absl::OkStatus();
+  }
+
+  File file_;
+  const size_t block_size_;
+  std::string buffer_;
+  std::future<absl::Status> pending_write_;
+};
+
+// k-way merge with log2(k) comparisons per record. Internal nodes remember
+// the loser of their match, so after the winner is replaced only the path
+// from its leaf to the root is replayed.
+class LoserTree {
+ public:
+  explicit LoserTree(std::vector<std::unique_ptr<RunReader>>* runs)
+      : runs_(*runs),
+        heads_(runs->size()),
+        valid_(runs->size()),
+        tree_(runs->size()) {}
+
+  absl::Status Init() {
+    if (runs_.empty()) {
+      return absl::OkStatus();
+    }
+    for (size_t i = 0; i < runs_.size(); ++i) {
+      absl::Status s = Advance(i);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    tree_[0] = runs_.size() == 1 ? 0 : Build(1);
+    return absl::OkStatus();
+  }
+
+  bool empty() const { return runs_.empty() || !valid_[tree_[0]]; }
+  Record& top() { return heads_[tree_[0]]; }
+
+  absl::Status Pop() {
+    const size_t winner = tree_[0];
+    absl::Status s = Advance(winner);
+    if (!s.ok()) {
+      return s;
+    }
+    size_t candidate = winner;
+    for (size_t node = (winner + runs_.size()) / 2; node >= 1; node /= 2) {
+      if (Less(tree_[node], candidate)) {
+        std::swap(tree_[node], candidate);
+      }
+    }
+    tree_[0] = candidate;
+    return absl::OkStatus();
+  }
+
+ private:
+  // Exhausted runs are larger than everything.
+  bool Less(size_t a, size_t b) const {
+    if (!valid_[a] || !valid_[b]) {
+      return valid_[a];
+    }
+    return heads_[a] < heads_[b];
+  }
+
+  // Leaves are the nodes [k, 2k), leaf k + i stands for |runs_[i]|.
+  size_t Build(size_t node) {
+    if (node >= runs_.size()) {
+      return node - runs_.size();
+    }
+    size_t winner = Build(2 * node);
+    size_t loser = Build(2 * node + 1);
+    if (Less(loser, winner)) {
+      std::swap(winner, loser);
+    }
+    tree_[node] = loser;
+    return winner;
+  }
+
+  absl::Status Advance(size_t i) {
+    absl::StatusOr<bool> has_next = runs_[i]->Next(&heads_[i]);
+    if (!has_next.ok()) {
+      return has_next.status();
+    }
+    valid_[i] = *has_next;
+    return absl::OkStatus();
+  }
+
+  std::vector<std::unique_ptr<RunReader>>& runs_;
+  std::vector<Record> heads_;
+  std::vector<bool> valid_;
+  std::vector<size_t> tree_;  // tree_[0] is the overall winner.
+};
+
+class ExternalSorter {
+ public:
+  explicit ExternalSorter(ExternalSortOptions options)
+      : options_(std::move(options)) {}
+
+  absl::Status Sort(File input, File output) {
+    std::vector<File> runs;
+    absl::Status s = CreateRuns(std::move(input), &runs);
+    if (!s.ok()) {
+      return s;
+    }
+
+    // Every run being merged holds two blocks: the current and the prefetched.
+    const size_t fan_in = std::max<size_t>(
+        2, options_.memory_budget / (2 * options_.block_size));
+    while (runs.size() > fan_in) {
+      absl::StatusOr<File> merged = CreateTempFile(options_.temp_dir);
+      if (!merged.ok()) {
+        return merged.status();
+      }
+      std::vector<File> group;
+      for (size_t i = 0; i < fan_in; ++i) {
+        group.push_back(std::move(runs[i]));
+      }
+      runs.erase(runs.begin(), runs.begin() + fan_in);
+      merged = Merge(std::move(group), *std::move(merged));
+      if (!merged.ok()) {
+        return merged.status();
+      }
+      runs.push_back(*std::move(merged));
+    }
+    return Merge(std::move(runs), std::move(output)).status();
+  }
+
+ private:
+  absl::Status CreateRuns(File input, std::vector<File>* runs) {
+    // |num_threads| runs being sorted plus the one being filled.
+    const size_t run_budget =
+        options_.memory_budget / (options_.num_threads + 1);
+    std::deque<std::future<absl::StatusOr<File>>> in_progress;
+    auto wait_oldest = [&]() -> absl::Status {
+      absl::StatusOr<File> run = in_progress.front().get();
+      in_progress.pop_front();
+      if (!run.ok()) {
+        return run.status();
+      }
+      runs->push_back(*std::move(run));
+      return absl::OkStatus();
+    };
+
+    RunReader reader(std::move(input), options_.block_size);
+    bool has_more = true;
+    while (has_more) {
+      std::vector<Record> records;
+      size_t bytes = 0;
+      while (bytes < run_budget) {
+        Record record;
+        absl::StatusOr<bool> has_next = reader.Next(&record);
+        if (!has_next.ok()) {
+          return has_next.status();
+        }
+        if (!(has_more = *has_next)) {
+          break;
+        }
+        bytes += sizeof(Record) + record.name.capacity();
+        records.push_back(std::move(record));
+      }
+      if (records.empty()) {
+        break;
+      }
+
+      if (in_progress.size() == static_cast<size_t>(options_.num_threads)) {
+        absl::Status s = wait_oldest();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      in_progress.push_back(std::async(
+          std::launch::async, [this, records = std::move(records)]() mutable {
+            return SortAndSpill(std::move(records));
+          }));
+    }
+    while (!in_progress.empty()) {
+      absl::Status s = wait_oldest();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<File> SortAndSpill(std::vector<Record> records) {
+    std::sort(records.begin(), records.end());
+    absl::StatusOr<File> file = CreateTempFile(options_.temp_dir);
+    if (!file.ok()) {
+      return file.status();
+    }
+    RunWriter writer(*std::move(file), options_.block_size);
+    for (const Record& record : records) {
+      absl::Status s = writer.Append(record);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return writer.Finish();
+  }
+
+  absl::StatusOr<File> Merge(std::vector<File> inputs, File output) {
+    std::vector<std::unique_ptr<RunReader>> runs;
+    for (File& input : inputs) {
+      runs.push_back(
+          std::make_unique<RunReader>(std::move(input), options_.block_size));
+    }
+    LoserTree tree(&runs);
+    absl::Status s = tree.Init();
+    RunWriter writer(std::move(output), options_.block_size);
+    while (s.ok() && !tree.empty()) {
+      s = writer.Append(tree.top());
+      if (s.ok()) {
+        s = tree.Pop();
+      }
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    return writer.Finish();
+  }
+
+  const ExternalSortOptions options_;
+};
+// --8<-- [end:code]
@@ -0,0 +1,118 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// Linux only: sleeps while |*word == expected|, until woken up or until the
+// absolute |deadline|. The kernel checks the deadline against CLOCK_REALTIME,
+// like |absl::Now()|.
+inline void FutexWaitUntil(std::atomic<uint32_t>* word, uint32_t expected,
+                           absl::Time deadline) {
+  timespec ts;
+  timespec* timeout = nullptr;
+  if (deadline != absl::InfiniteFuture()) {
+    ts = absl::ToTimespec(deadline);
+    timeout = &ts;
+  }
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word),
+            FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME, expected, timeout,
+            nullptr, FUTEX_BITSET_MATCH_ANY);
+}
+
+inline void FutexWakeOne(std::atomic<uint32_t>* word) {
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, 1,
+            nullptr, nullptr, 0);
+}
+
+// An auto-reset event for one waiting thread and any number of notifying
+// threads. Waiting goes through three phases:
+//
+// 1. Spin on the state with |CpuRelax()|: wakes up within nanoseconds, but
+//    burns the core.
+// 2. Yield a few times to other runnable threads.
+// 3. Park in the kernel until notified or until the deadline.
+//
+// The spin budget adapts to the recent waits: it grows towards twice the
+// spins which were enough, and shrinks every time spinning did not help.
+//
+// Notifications which arrive before the waiter consumes the previous one are
+// merged into it.
+class SpinThenParkEvent {
+ public:
+  void Notify() {
+    if (state_.exchange(kNotified, std::memory_order_release) == kParked) {
+      FutexWakeOne(&state_);
+    }
+  }
+
+  // Returns true if notified, false if |deadline| passed first.
+  bool WaitUntil(absl::Time deadline) {
+    for (int spins = 0; spins < spin_budget_; ++spins) {
+      if (TryConsume()) {
+        spin_budget_ = std::clamp((spin_budget_ + 2 * spins) / 2,
+                                  kMinSpinBudget, kMaxSpinBudget);
+        return true;
+      }
+      CpuRelax();
+    }
+    spin_budget_ = std::max(spin_budget_ / 2, kMinSpinBudget);
+
+    for (int i = 0; i < kYields; ++i) {
+      if (TryConsume()) {
+        return true;
+      }
+      std::this_thread::yield();
+    }
+
+    while (true) {
+      uint32_t state = kEmpty;
+      // Afterwards |state| is the previous value: kEmpty (now parked),
+      // kParked (still parked after a spurious wake-up) or kNotified.
+      state_.compare_exchange_strong(state, kParked, std::memory_order_acquire);
+      if (state == kNotified) {
+        state_.store(kEmpty, std::memory_order_relaxed);
+        return true;
+      }
+      if (absl::Now() >= deadline) {
+        state = kParked;
+        if (state_.compare_exchange_strong(state, kEmpty,
+                                           std::memory_order_acquire)) {
+          return false;
+        }
+        continue;  // Notified in the meantime.
+      }
+      FutexWaitUntil(&state_, kParked, deadline);
+    }
+  }
+
+  bool WaitFor(absl::Duration timeout) {
+    return WaitUntil(absl::Now() + timeout);
+  }
+
+ private:
+  static constexpr uint32_t kEmpty = 0;
+  static constexpr uint32_t kNotified = 1;
+  static constexpr uint32_t kParked = 2;  // The waiter sleeps in the kernel.
+
+  // Roughly 1us to 50us of spinning, depending on the CPU.
+  static constexpr int kMinSpinBudget = 64;
+  static constexpr int kMaxSpinBudget = 16 * 1024;
+  static constexpr int kYields = 4;
+
+  bool TryConsume() {
+    return state_.load(std::memory_order_relaxed) == kNotified &&
+           state_.exchange(kEmpty, std::memory_order_acquire) == kNotified;
+  }
+
+  std::atomic<uint32_t> state_{kEmpty};
+  int spin_budget_ = kMinSpinBudget;  // Only used by the waiting thread.
+};
+// --8<-- [end:code]
@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Measures the time from |notify()| on one thread until |wait()| returns on
+// another. The notifier pauses a random 0-100us between rounds, so that the
+// waiter sometimes catches the notification while spinning and sometimes
+// has to park.
+void PrintWakeupLatency(absl::string_view name, std::function<void()> notify,
+                        std::function<void()> wait) {
+  constexpr int kRounds = 10000;
+  std::vector<int64_t> latencies_ns(kRounds);
+  std::atomic<int64_t> notify_time_ns{0};
+  std::atomic<bool> round_done{true};
+
+  std::thread waiter([&]() {
+    for (int i = 0; i < kRounds; ++i) {
+      wait();
+      latencies_ns[i] = absl::GetCurrentTimeNanos() - notify_time_ns.load();
+      round_done.store(true);
+    }
+  });
+
+  absl::BitGen gen;
+  for (int i = 0; i < kRounds; ++i) {
+    while (!round_done.exchange(false)) {
+      std::this_thread::yield();
+    }
+    absl::SleepFor(absl::Microseconds(absl::Uniform(gen, 0, 100)));
+    notify_time_ns.store(absl::GetCurrentTimeNanos());
+    notify();
+  }
+  waiter.join();
+
+  std::sort(latencies_ns.begin(), latencies_ns.end());
+  absl::PrintF("%s: p50=%dns p99=%dns p99.9=%dns\n", name,
+               latencies_ns[kRounds / 2], latencies_ns[kRounds * 99 / 100],
+               latencies_ns[kRounds * 999 / 1000]);
+}
+
+void CompareWakeupLatency() {
+  SpinThenParkEvent event;
+  PrintWakeupLatency(
+      "SpinThenParkEvent", [&]() { event.Notify(); },
+      [&]() { event.WaitFor(absl::Seconds(1)); });
+
+  // |absl::Notification| cannot be reset, use a fresh one per round.
+  std::vector<absl::Notification> notifications(10000);
+  int notified = 0;
+  int waited = 0;
+  PrintWakeupLatency(
+      "absl::Notification",
+      [&]() { notifications[notified++].Notify(); },
+      [&]() {
+        notifications[waited++].WaitForNotificationWithTimeout(
+            absl::Seconds(1));
+      });
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool ready = false;
+  PrintWakeupLatency(
+      "std::condition_variable",
+      [&]() {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          ready = true;
+        }
+        cv.notify_one();
+      },
+      [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, std::chrono::seconds(1), [&] { return ready; });
+        ready = false;
+      });
+}
+// --8<-- [end:code]
@@ -0,0 +1,335 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+using Closure = std::function<void()>;
+
+// Chase-Lev work-stealing deque of |Closure*| with a fixed capacity. The owner
+// pushes and pops at the bottom (LIFO, the most recent task is still in the
+// cache), other workers steal from the top (FIFO, the oldest and usually the
+// largest piece of work).
+class WorkStealingDeque {
+ public:
+  explicit WorkStealingDeque(int64_t capacity)
+      : mask_(capacity - 1), tasks_(new std::atomic<Closure*>[capacity]) {}
+
+  // Owner only. Returns false if the deque is full.
+  bool Push(Closure* task) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t > mask_) {
+      return false;
+    }
+    tasks_[b & mask_].store(task, std::memory_order_relaxed);
+    bottom_.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Owner only. Returns nullptr if the deque is empty.
+  Closure* Pop() {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Closure* task = tasks_[b & mask_].load(std::memory_order_relaxed);
+    if (t == b) {
+      // The last task: race with the thieves for it.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        task = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  // Any thread. Returns nullptr if the deque is empty or another thief won.
+  Closure* Steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    Closure* task = tasks_[t & mask_].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return task;
+  }
+
+  bool empty() const {
+    return bottom_.load(std::memory_order_relaxed) <=
+           top_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const int64_t mask_;
+  const std::unique_ptr<std::atomic<Closure*>[]> tasks_;
+  ABSL_CACHELINE_ALIGNED std::atomic<int64_t> top_{0};
+  ABSL_CACHELINE_ALIGNED std::atomic<int64_t> bottom_{0};
+};
+
+struct ThreadPoolOptions {
+  int num_threads = std::thread::hardware_concurrency();
+  // Pins worker i to core i % (number of cores).
+  bool pin_to_cores = false;
+  int64_t deque_capacity = 4096;  // Per worker, a power of two.
+};
+
+// Tasks submitted from a worker go to its own deque, other tasks go to a
+// shared injection queue. Idle workers take from their deque, then from the
+// injection queue, then steal from the others, and only then sleep.
+//
+// |Stop()| runs the tasks already submitted before it returns. Stop the
+// services which submit tasks before the pool.
+class WorkStealingThreadPool : public Service {
+ public:
+  explicit WorkStealingThreadPool(ThreadPoolOptions options)
+      : options_(options) {}
+
+  Status Start() override {
+    for (int i = 0; i < options_.num_threads; ++i) {
+      workers_.push_back(std::make_unique<Worker>(options_.deque_capacity));
+    }
+    for (int i = 0; i < options_.num_threads; ++i) {
+      workers_[i]->thread =
+          std::thread(&WorkStealingThreadPool::WorkerEntryPoint, this, i);
+      if (options_.pin_to_cores) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+        pthread_setaffinity_np(workers_[i]->thread.native_handle(),
+                               sizeof(cpus), &cpus);
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Stop() override {
+    {
+      absl::MutexLock lock(&sleep_mutex_);
+      stopping_ = true;
+      sleep_cv_.SignalAll();
+    }
+    for (auto& worker : workers_) {
+      if (worker->thread.joinable()) {
+        worker->thread.join();
+      }
+    }
+    return Status::OK();
+  }
+
+  void Submit(Closure task) {
+    auto* t = new Closure(std::move(task));
+    Worker* self = CurrentWorker();
+    if (self == nullptr || !self->deque.Push(t)) {
+      absl::MutexLock lock(&injection_mutex_);
+      injection_queue_.push_back(t);
+      injection_size_.fetch_add(1, std::memory_order_relaxed);
+    }
+    WakeOne();
+  }
+
+  // Fork-join: |Run()| submits a task, |Wait()| returns once all of them have
+  // finished. A worker which waits keeps running other tasks meanwhile, so
+  // groups can nest without running out of threads.
+  class TaskGroup {
+   public:
+    explicit TaskGroup(WorkStealingThreadPool* pool) : pool_(pool) {}
+    ~TaskGroup() { Wait(); }
+
+    void Run(Closure task) {
+      pending_.fetch_add(1, std::memory_order_relaxed);
+      pool_->Submit([this, task = std::move(task)]() {
+        task();
+        pending_.fetch_sub(1, std::memory_order_release);
+      });
+    }
+
+    void Wait() {
+      while (pending_.load(std::memory_order_acquire) > 0) {
+        if (!pool_->RunOneTask()) {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+   private:
+    WorkStealingThreadPool* pool_;  // Not owned.
+    std::atomic<int64_t> pending_{0};
+  };
+
+  // Calls |fn(i)| for every i in [begin, end). Ranges are split lazily: a
+  // task cuts off half of its remaining range for others to steal only while
+  // the tasks it submitted before are all taken, so the number of tasks adapts
+  // to how many workers are idle instead of being fixed upfront. This also
+  // holds on a thread outside the pool, which runs tasks in |Wait()|: its
+  // halves go to the injection queue.
+  void ParallelFor(int64_t begin, int64_t end, int64_t min_chunk,
+                   absl::FunctionRef<void(int64_t)> fn) {
+    min_chunk = std::max<int64_t>(min_chunk, 1);
+    TaskGroup group(this);
+    std::function<void(int64_t, int64_t)> run_range;
+    run_range = [&](int64_t b, int64_t e) {
+      while (b < e) {
+        if (e - b > 2 * min_chunk && SubmittedTasksTaken()) {
+          const int64_t mid = b + (e - b) / 2;
+          group.Run([&run_range, mid, e]() { run_range(mid, e); });
+          e = mid;
+        }
+        const int64_t chunk_end = std::min(b + min_chunk, e);
+        for (; b < chunk_end; ++b) {
+          fn(b);
+        }
+      }
+    };
+    group.Run([&run_range, begin, end]() { run_range(begin, end); });
+    group.Wait();
+  }
+
+ private:
+  struct Worker {
+    explicit Worker(int64_t deque_capacity) : deque(deque_capacity) {}
+
+    WorkStealingDeque deque;
+    std::thread thread;
+  };
+
+  // The worker the calling thread is, nullptr if it is not one of ours.
+  Worker* CurrentWorker() {
+    return current_pool_ == this ? workers_[current_index_].get() : nullptr;
+  }
+
+  // Whether the queue the calling thread submits to is empty: its own deque
+  // for a worker, the injection queue for any other thread.
+  bool SubmittedTasksTaken() {
+    Worker* self = CurrentWorker();
+    return self != nullptr
+               ? self->deque.empty()
+               : injection_size_.load(std::memory_order_relaxed) == 0;
+  }
+
+  void WorkerEntryPoint(int index) {
+    current_pool_ = this;
+    current_index_ = index;
+    while (true) {
+      if (RunOneTask()) {
+        continue;
+      }
+      if (!SleepUntilWork()) {
+        return;
+      }
+    }
+  }
+
+  // Runs one task from anywhere, returns false if there was none.
+  bool RunOneTask() {
+    Closure* task = FindTask();
+    if (task == nullptr) {
+      return false;
+    }
+    (*task)();
+    delete task;
+    return true;
+  }
+
+  Closure* FindTask() {
+    Worker* self = CurrentWorker();
+    if (self != nullptr) {
+      if (Closure* task = self->deque.Pop()) {
+        return task;
+      }
+    }
+    if (injection_size_.load(std::memory_order_relaxed) > 0) {
+      absl::MutexLock lock(&injection_mutex_);
+      if (!injection_queue_.empty()) {
+        Closure* task = injection_queue_.front();
+        injection_queue_.pop_front();
+        injection_size_.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+      }
+    }
+    // Start at a different victim in every worker to spread the contention.
+    const size_t n = workers_.size();
+    const size_t start = self != nullptr ? current_index_ + 1 : 0;
+    for (size_t i = 0; i < n; ++i) {
+      Worker* victim = workers_[(start + i) % n].get();
+      if (victim != self) {
+        if (Closure* task = victim->deque.Steal()) {
+          return task;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  bool HasWork() const {
+    if (injection_size_.load(std::memory_order_relaxed) > 0) {
+      return true;
+    }
+    for (const auto& worker : workers_) {
+      if (!worker->deque.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Returns false once the pool is stopping and no work is left.
+  bool SleepUntilWork() {
+    uint64_t epoch;
+    {
+      absl::MutexLock lock(&sleep_mutex_);
+      epoch = wake_epoch_;
+      num_sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    }
+    // Check again after announcing ourselves: a |Submit()| racing with the
+    // failed |RunOneTask()| either sees |num_sleeping_| or its task is
+    // visible here.
+    bool has_work = HasWork();
+    absl::MutexLock lock(&sleep_mutex_);
+    while (!has_work && wake_epoch_ == epoch && !stopping_) {
+      sleep_cv_.Wait(&sleep_mutex_);
+    }
+    num_sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    return has_work || !stopping_ || HasWork();
+  }
+
+  void WakeOne() {
+    // Orders the push before reading |num_sleeping_|.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_sleeping_.load(std::memory_order_relaxed) > 0) {
+      absl::MutexLock lock(&sleep_mutex_);
+      ++wake_epoch_;
+      sleep_cv_.Signal();
+    }
+  }
+
+  static thread_local WorkStealingThreadPool* current_pool_;
+  static thread_local size_t current_index_;
+
+  const ThreadPoolOptions options_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  absl::Mutex injection_mutex_;
+  std::deque<Closure*> injection_queue_ ABSL_GUARDED_BY(injection_mutex_);
+  std::atomic<size_t> injection_size_{0};
+
+  absl::Mutex sleep_mutex_;
+  absl::CondVar sleep_cv_;
+  uint64_t wake_epoch_ ABSL_GUARDED_BY(sleep_mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(sleep_mutex_) = false;
+  std::atomic<int> num_sleeping_{0};
+};
+
+thread_local WorkStealingThreadPool* WorkStealingThreadPool::current_pool_ =
+    nullptr;
+thread_local size_t WorkStealingThreadPool::current_index_ = 0;
+// --8<-- [end:code]
@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Below the cutoff a task is too small to be worth scheduling.
+constexpr int kSequentialCutoff = 30;
+
+int64_t ParallelFibonacci(WorkStealingThreadPool* pool, int n) {
+  if (n < kSequentialCutoff) {
+    return fibonacci(n);
+  }
+  int64_t a;
+  WorkStealingThreadPool::TaskGroup group(pool);
+  group.Run([&a, pool, n]() { a = ParallelFibonacci(pool, n - 1); });
+  const int64_t b = ParallelFibonacci(pool, n - 2);
+  group.Wait();
+  return a + b;
+}
+
+// The same with one new thread per task.
+int64_t AsyncFibonacci(int n) {
+  if (n < kSequentialCutoff) {
+    return fibonacci(n);
+  }
+  std::future<int64_t> a =
+      std::async(std::launch::async, AsyncFibonacci, n - 1);
+  const int64_t b = AsyncFibonacci(n - 2);
+  return a.get() + b;
+}
+
+void BM_PoolFibonacci(benchmark::State& state) {
+  ThreadPoolOptions options;
+  options.num_threads = state.range(0);
+  WorkStealingThreadPool pool(options);
+  pool.Start().IgnoreError();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ParallelFibonacci(&pool, 42));
+  }
+  pool.Stop().IgnoreError();
+}
+BENCHMARK(BM_PoolFibonacci)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+void BM_AsyncFibonacci(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(AsyncFibonacci(42));
+  }
+}
+BENCHMARK(BM_AsyncFibonacci)->UseRealTime()->Unit(benchmark::kMillisecond);
+// --8<-- [end:code]
@@ -0,0 +1,485 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Coroutine frames are allocated by |operator new| of the promise type. A
+// coroutine function always needs the same frame size, so a few size classes
+// with per-thread free lists serve almost every frame without locks. A frame
+// freed on another thread than the one which allocated it moves to the free
+// list of that thread.
+class FramePool {
+ public:
+  static void* Allocate(size_t size) {
+    const size_t size_class = SizeClass(size);
+    if (size_class >= kNumSizeClasses) {
+      return ::operator new(size);
+    }
+    FreeList& list = free_lists_[size_class];
+    if (list.head == nullptr) {
+      return ::operator new((size_class + 1) * kGranularity);
+    }
+    FreeBlock* block = list.head;
+    list.head = block->next;
+    --list.length;
+    return block;
+  }
+
+  static void Free(void* frame, size_t size) {
+    const size_t size_class = SizeClass(size);
+    if (size_class >= kNumSizeClasses ||
+        free_lists_[size_class].length >= kMaxFreeBlocks) {
+      ::operator delete(frame);
+      return;
+    }
+    FreeList& list = free_lists_[size_class];
+    list.head = new (frame) FreeBlock{list.head};
+    ++list.length;
+  }
+
+ private:
+  static constexpr size_t kGranularity = 64;
+  static constexpr size_t kNumSizeClasses = 16;  // Frames up to 1 KiB.
+  static constexpr size_t kMaxFreeBlocks = 64 * 1024;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  struct FreeList {
+    ~FreeList() {
+      while (head != nullptr) {
+        ::operator delete(std::exchange(head, head->next));
+      }
+    }
+
+    FreeBlock* head = nullptr;
+    size_t length = 0;
+  };
+
+  static size_t SizeClass(size_t size) { return (size - 1) / kGranularity; }
+
+  static thread_local FreeList free_lists_[kNumSizeClasses];
+};
+
+thread_local FramePool::FreeList FramePool::free_lists_[kNumSizeClasses];
+
+// A lazily started coroutine which produces a |T|, usually |absl::Status| or
+// |absl::StatusOr<U>|. Nothing runs until the task is awaited; the awaiting
+// coroutine resumes right where the task finishes, on the same thread.
+//
+// Example:
+//   Task<absl::StatusOr<int>> CountLines(AsyncContext context,
+//                                        std::string filename) {
+//     CO_ASSIGN_OR_RETURN(std::string content,
+//                         co_await ReadFileAsync(context, filename));
+//     co_return std::count(content.begin(), content.end(), '\n');
+//   }
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  struct promise_type;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  // Resumes the awaiting coroutine, if any, once the task has finished.
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(Handle handle) noexcept {
+      std::coroutine_handle<> continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  struct promise_type {
+    Task get_return_object() { return Task(Handle::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    template <typename U>
+    void return_value(U&& value) {
+      result.emplace(std::forward<U>(value));
+    }
+    // Built without exceptions, errors travel in |T|.
+    void unhandled_exception() { std::terminate(); }
+
+    static void* operator new(size_t size) { return FramePool::Allocate(size); }
+    static void operator delete(void* frame, size_t size) {
+      FramePool::Free(frame, size);
+    }
+
+    std::optional<T> result;
+    std::coroutine_handle<> continuation;
+  };
+
+  Task(Task&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  Task& operator=(Task&& other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // Starts the task and suspends the caller until it finishes. Symmetric
+  // transfer: the caller hands its thread over to the task instead of calling
+  // |resume()| on it, so long chains of tasks which finish synchronously do
+  // not grow the stack.
+  auto operator co_await() && noexcept {
+    struct Awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+      }
+      T await_resume() { return std::move(*handle.promise().result); }
+
+      Handle handle;
+    };
+    return Awaiter{handle_};
+  }
+
+ private:
+  explicit Task(Handle handle) : handle_(handle) {}
+
+  Handle handle_;
+};
+
+// The coroutine versions of |RETURN_IF_NOT_OK()| and |ASSIGN_OR_RETURN()|: a
+// plain |return| is not allowed in a coroutine.
+#define CO_RETURN_IF_NOT_OK(expr)     \
+  do {                                \
+    absl::Status _status = (expr);    \
+    if (!_status.ok()) {              \
+      co_return _status;              \
+    }                                 \
+  } while (0)
+
+#define CO_ASSIGN_OR_RETURN(lhs, expr) \
+  CO_ASSIGN_OR_RETURN_IMPL(CO_STATUS_CONCAT(_status_or_, __LINE__), lhs, expr)
+#define CO_ASSIGN_OR_RETURN_IMPL(status_or, lhs, expr) \
+  auto status_or = (expr);                             \
+  if (!status_or.ok()) {                               \
+    co_return std::move(status_or).status();           \
+  }                                                    \
+  lhs = *std::move(status_or)
+#define CO_STATUS_CONCAT(x, y) CO_STATUS_CONCAT_IMPL(x, y)
+#define CO_STATUS_CONCAT_IMPL(x, y) x##y
+
+// Starts |task| on the calling thread without waiting for it. |done| gets the
+// result on whichever thread the task finishes.
+template <typename T>
+void Spawn(Task<T> task, std::function<void(T)> done) {
+  struct Detached {
+    struct promise_type {
+      Detached get_return_object() { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      // Destroys the frame right away, nobody awaits a detached coroutine.
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+
+      static void* operator new(size_t size) {
+        return FramePool::Allocate(size);
+      }
+      static void operator delete(void* frame, size_t size) {
+        FramePool::Free(frame, size);
+      }
+    };
+  };
+  // Coroutine parameters are moved into the frame, so |task| and |done| live
+  // as long as the coroutine.
+  [](Task<T> task, std::function<void(T)> done) -> Detached {
+    done(co_await std::move(task));
+  }(std::move(task), std::move(done));
+}
+
+// Awaits an operation which reports its result through a callback, e.g. a
+// timer or an event loop. The awaiting coroutine then resumes on |executor|,
+// never inside the callback, so it cannot stall the thread which runs it.
+template <typename T>
+class CallbackAwaitable {
+ public:
+  using Callback = std::function<void(T)>;
+
+  CallbackAwaitable(WorkStealingThreadPool* executor,
+                    std::function<void(Callback)> start)
+      : executor_(executor), start_(std::move(start)) {}
+
+  bool await_ready() noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> caller) {
+    // |this| lives in the frame of |caller|, which stays suspended until the
+    // callback resumes it. The coroutine may resume, finish and free the frame
+    // before |start| returns, so |start| must not live in the frame.
+    std::function<void(Callback)> start = std::move(start_);
+    start([this, caller](T result) {
+      result_.emplace(std::move(result));
+      executor_->Submit([caller]() { caller.resume(); });
+    });
+  }
+  T await_resume() { return std::move(*result_); }
+
+ private:
+  WorkStealingThreadPool* executor_;  // Not owned.
+  std::function<void(Callback)> start_;
+  std::optional<T> result_;
+};
+
+// One background thread which runs callbacks at their deadlines.
+class TimerQueue : public Service {
+ public:
+  using Callback = std::function<void(absl::Status)>;
+
+  Status Start() override {
+    background_thread_ =
+        std::make_unique<std::thread>(&TimerQueue::ThreadEntryPoint, this);
+    return Status::OK();
+  }
+
+  // Fails the timers which are still waiting with |absl::CancelledError|.
+  Status Stop() override {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+      cv_.Signal();
+    }
+    background_thread_->join();
+    background_thread_.reset();
+    std::vector<Callback> cancelled;
+    {
+      absl::MutexLock lock(&mutex_);
+      for (; !timers_.empty(); timers_.pop()) {
+        cancelled.push_back(std::move(timers_.top().callback));
+      }
+    }
+    for (Callback& callback : cancelled) {
+      callback(absl::CancelledError("TimerQueue stopped."));
+    }
+    return Status::OK();
+  }
+
+  // |callback| runs on the timer thread and must not block. Call before
+  // |Stop()|.
+  void Schedule(absl::Time deadline, Callback callback) {
+    absl::MutexLock lock(&mutex_);
+    if (timers_.empty() || deadline < timers_.top().deadline) {
+      cv_.Signal();
+    }
+    timers_.push({deadline, std::move(callback)});
+  }
+
+ private:
+  struct Timer {
+    absl::Time deadline;
+    mutable Callback callback;  // Moved out of |timers_.top()|.
+
+    bool operator>(const Timer& other) const {
+      return deadline > other.deadline;
+    }
+  };
+
+  void ThreadEntryPoint() {
+    std::vector<Callback> expired;
+    while (true) {
+      {
+        absl::MutexLock lock(&mutex_);
+        while (!stopping_ &&
+               (timers_.empty() || timers_.top().deadline > absl::Now())) {
+          if (timers_.empty()) {
+            cv_.Wait(&mutex_);
+          } else {
+            cv_.WaitWithDeadline(&mutex_, timers_.top().deadline);
+          }
+        }
+        if (stopping_) {
+          return;
+        }
+        const absl::Time now = absl::Now();
+        while (!timers_.empty() && timers_.top().deadline <= now) {
+          expired.push_back(std::move(timers_.top().callback));
+          timers_.pop();
+        }
+      }
+      for (Callback& callback : expired) {
+        callback(absl::OkStatus());
+      }
+      expired.clear();
+    }
+  }
+
+  absl::Mutex mutex_;
+  absl::CondVar cv_;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_
+      ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+  std::unique_ptr<std::thread> background_thread_;
+};
+
+// Where coroutines run and what they wait on. Stop the services which spawn
+// tasks first, then |timers|, then the pools.
+struct AsyncContext {
+  // Runs the coroutines. Only non-blocking code should run here.
+  WorkStealingThreadPool* executor;
+  // A few threads for blocking system calls.
+  WorkStealingThreadPool* blocking_pool;
+  TimerQueue* timers;
+};
+
+// Returns |absl::CancelledError| if |timers| stops first.
+CallbackAwaitable<absl::Status> SleepFor(const AsyncContext& context,
+                                         absl::Duration duration) {
+  const absl::Time deadline = absl::Now() + duration;
+  return {context.executor,
+          [timers = context.timers, deadline](auto done) {
+            timers->Schedule(deadline, std::move(done));
+          }};
+}
+
+// Regular files are always "ready" for epoll, a read blocks on the disk
+// anyway. The read runs on |blocking_pool| instead, so the number of threads
+// blocked in read(2) is bounded by its size, however many reads are in
+// flight. (io_uring would avoid the extra threads, at the price of a Linux
+// 5.1+ dependency.)
+CallbackAwaitable<absl::StatusOr<std::string>> ReadFileAsync(
+    const AsyncContext& context, std::string filename) {
+  return {context.executor, [blocking_pool = context.blocking_pool,
+                             filename = std::move(filename)](auto done) {
+            blocking_pool->Submit([filename, done]() {
+              File file(::open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+              if (!file.valid()) {
+                done(IOError(filename, errno));
+                return;
+              }
+              std::string content;
+              char buffer[64 * 1024];
+              ssize_t n;
+              while ((n = ::read(file.fd(), buffer, sizeof(buffer))) > 0) {
+                content.append(buffer, n);
+              }
+              if (n < 0) {
+                done(IOError(filename, errno));
+                return;
+              }
+              done(std::move(content));
+            });
+          }};
+}
+
+// |Oauth2TokenCache::GetAccessToken()| is usually a copy under a reader lock,
+// but it fetches a token over the network when it has no valid one, e.g. on
+// the first call. Like a file read, it runs on |blocking_pool|.
+CallbackAwaitable<absl::StatusOr<std::string>> GetAccessTokenAsync(
+    const AsyncContext& context,
+    std::shared_ptr<Oauth2TokenCache> token_cache) {
+  return {context.executor, [blocking_pool = context.blocking_pool,
+                             token_cache = std::move(token_cache)](auto done) {
+            blocking_pool->Submit(
+                [token_cache, done]() { done(token_cache->GetAccessToken()); });
+          }};
+}
+
+// |HttpPipeline| and |HttpClient| from the Communication chapter get callback
+// and coroutine flavors of their asynchronous calls, so no thread blocks in
+// |ResponseFuture::get()|.
+class HttpPipeline {
+ public:
+  // Omitted: the members shown in the Communication chapter.
+
+  // The same as |Submit()| above, except that the result goes to |done|
+  // instead of to a future: on the event loop thread, or right away on the
+  // calling thread if the call fails fast, e.g. after |Stop()|. |done| must
+  // not block.
+  void Submit(std::string request, absl::Time deadline,
+              std::function<void(absl::StatusOr<HttpResponse>)> done) {
+    auto call = std::make_shared<Call>();
+    call->request = std::move(request);
+    call->deadline = deadline;
+    call->callback = std::move(done);
+    Enqueue(std::move(call));
+  }
+
+ private:
+  // |Call| from the Communication chapter, with a callback which |Finish()|
+  // prefers to the promise.
+  struct Call {
+    std::string request;
+    absl::Time deadline;
+    std::promise<absl::StatusOr<HttpResponse>> promise;
+    std::function<void(absl::StatusOr<HttpResponse>)> callback;
+    bool done = false;  // Result delivered, e.g. by the deadline.
+
+    void Finish(absl::StatusOr<HttpResponse> result) {
+      if (done) {
+        return;
+      }
+      done = true;
+      if (callback) {
+        callback(std::move(result));
+      } else {
+        promise.set_value(std::move(result));
+      }
+    }
+  };
+};
+
+class HttpClient {
+ public:
+  // Omitted: the members shown in the Communication chapter.
+
+  // Takes |path| by value: a coroutine keeps copies of its parameters in its
+  // frame, but a reference or a |string_view| would dangle once the caller
+  // moves on while the coroutine is suspended.
+  Task<absl::StatusOr<HttpResponse>> CoGet(AsyncContext context,
+                                           std::string path,
+                                           absl::Duration timeout);
+};
+
+Task<absl::StatusOr<HttpResponse>> HttpClient::CoGet(AsyncContext context,
+                                                     std::string path,
+                                                     absl::Duration timeout) {
+  CO_ASSIGN_OR_RETURN(
+      std::string token,
+      co_await GetAccessTokenAsync(context, options_.token_cache));
+  std::string request =
+      absl::StrCat("GET ", path, " HTTP/1.1\r\nHost: ", options_.endpoint,
+                   "\r\nAuthorization: Bearer ", token, "\r\n\r\n");
+  CallbackAwaitable<absl::StatusOr<HttpResponse>> response(
+      context.executor,
+      [pipeline = options_.pipeline.get(), request = std::move(request),
+       deadline = absl::Now() + timeout](auto done) {
+        pipeline->Submit(request, deadline, std::move(done));
+      });
+  co_return co_await response;
+}
+
+// Example: reads a list of paths from |filename| and fetches each of them,
+// retrying failed requests after a pause. Reads like blocking code, but
+// holds no thread while it waits.
+Task<absl::StatusOr<std::vector<HttpResponse>>> FetchAll(
+    AsyncContext context, HttpClient* client, std::string filename) {
+  CO_ASSIGN_OR_RETURN(std::string paths,
+                      co_await ReadFileAsync(context, filename));
+  std::vector<HttpResponse> responses;
+  for (absl::string_view path :
+       absl::StrSplit(paths, '\n', absl::SkipEmpty())) {
+    absl::StatusOr<HttpResponse> response;
+    for (int attempt = 0; attempt < 3; ++attempt) {
+      if (attempt > 0) {
+        CO_RETURN_IF_NOT_OK(
+            co_await SleepFor(context, absl::Milliseconds(100) * attempt));
+      }
+      response = co_await client->CoGet(context, std::string(path),
+                                        absl::Milliseconds(200));
+      if (response.ok() || !absl::IsDeadlineExceeded(response.status())) {
+        break;
+      }
+    }
+    CO_RETURN_IF_NOT_OK(response.status());
+    responses.push_back(*std::move(response));
+  }
+  co_return responses;
+}
+// --8<-- [end:code]
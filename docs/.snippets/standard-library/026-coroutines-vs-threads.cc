@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Returns a field of /proc/self/status, e.g. "Threads" or "VmRSS" (in KiB).
+int64_t ReadProcStatus(absl::string_view field) {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    absl::string_view value = line;
+    int64_t result;
+    if (absl::ConsumePrefix(&value, field) &&
+        absl::ConsumePrefix(&value, ":") &&
+        absl::SimpleAtoi(
+            absl::StripSuffix(absl::StripAsciiWhitespace(value), " kB"),
+            &result)) {
+      return result;
+    }
+  }
+  return -1;
+}
+
+constexpr int kInFlight = 100000;
+constexpr absl::Duration kOperationTime = absl::Seconds(2);
+
+// Stands for any operation which mostly waits, e.g. a long poll.
+Task<absl::Status> WaitingOperation(AsyncContext context) {
+  CO_RETURN_IF_NOT_OK(co_await SleepFor(context, kOperationTime));
+  co_return absl::OkStatus();
+}
+
+void PrintInFlight(absl::string_view name, int in_flight, int64_t rss_before) {
+  absl::PrintF("%s: %d in flight, %d threads, RSS +%d MiB\n", name, in_flight,
+               ReadProcStatus("Threads"),
+               (ReadProcStatus("VmRSS") - rss_before) / 1024);
+}
+
+void CompareCoroutinesWithThreads() {
+  {
+    WorkStealingThreadPool executor(ThreadPoolOptions{.num_threads = 4});
+    WorkStealingThreadPool blocking_pool(ThreadPoolOptions{.num_threads = 4});
+    TimerQueue timers;
+    executor.Start().IgnoreError();
+    blocking_pool.Start().IgnoreError();
+    timers.Start().IgnoreError();
+    const AsyncContext context{&executor, &blocking_pool, &timers};
+
+    const int64_t rss_before = ReadProcStatus("VmRSS");
+    std::atomic<int> remaining{kInFlight};
+    absl::Notification all_done;
+    for (int i = 0; i < kInFlight; ++i) {
+      Spawn<absl::Status>(WaitingOperation(context), [&](absl::Status s) {
+        CHECK_OK(s);
+        if (remaining.fetch_sub(1) == 1) {
+          all_done.Notify();
+        }
+      });
+    }
+    PrintInFlight("Coroutines", kInFlight, rss_before);
+    all_done.WaitForNotification();
+
+    timers.Stop().IgnoreError();
+    blocking_pool.Stop().IgnoreError();
+    executor.Stop().IgnoreError();
+  }
+
+  // Thread per request, with the default 8 MiB stacks. Creating the threads
+  // stops early once the kernel refuses (see /proc/sys/kernel/threads-max and
+  // |ulimit -u|).
+  const int64_t rss_before = ReadProcStatus("VmRSS");
+  std::vector<pthread_t> threads;
+  threads.reserve(kInFlight);
+  for (int i = 0; i < kInFlight; ++i) {
+    pthread_t thread;
+    auto entry_point = [](void*) -> void* {
+      absl::SleepFor(kOperationTime);
+      return nullptr;
+    };
+    if (pthread_create(&thread, nullptr, entry_point, nullptr) != 0) {
+      break;
+    }
+    threads.push_back(thread);
+  }
+  PrintInFlight("Thread per request", threads.size(), rss_before);
+  for (pthread_t thread : threads) {
+    pthread_join(thread, nullptr);
+  }
+}
+// --8<-- [end:code]
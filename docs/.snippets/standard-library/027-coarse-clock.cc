@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// A clock for timestamps on hot paths. A background thread stores
+// |absl::Now()| into an atomic every |resolution|, and |Now()| is a single
+// relaxed load of it.
+//
+// |Now()| lags the real time by up to |resolution| plus the delay before the
+// ticker thread runs again, which grows when all cores are busy. Use it for
+// timestamps which tolerate that, e.g. request start times for metrics or
+// |last_known_healthy_time()|. Use |PreciseNow()| to order events or to
+// measure anything shorter than a few resolutions.
+struct CoarseClockOptions {
+  absl::Duration resolution = absl::Milliseconds(1);
+};
+
+class CoarseClock : public Service {
+ public:
+  explicit CoarseClock(CoarseClockOptions options = {}) : options_(options) {}
+  ~CoarseClock() override { Stop().IgnoreError(); }
+
+  Status Start() override {
+    now_ns_.store(absl::GetCurrentTimeNanos(), std::memory_order_relaxed);
+    background_thread_ = std::make_unique<std::thread>(
+        &CoarseClock::BackgroundThreadEntryPoint, this);
+    return Status::OK();
+  }
+
+  Status Stop() override {
+    if (background_thread_ == nullptr) {
+      return Status::OK();
+    }
+    stopping_notification_.Notify();
+    background_thread_->join();
+    background_thread_.reset();
+    return Status::OK();
+  }
+
+  absl::Time Now() const { return absl::FromUnixNanos(NowNanos()); }
+  int64_t NowNanos() const { return now_ns_.load(std::memory_order_relaxed); }
+
+  static absl::Time PreciseNow() { return absl::Now(); }
+
+ private:
+  void BackgroundThreadEntryPoint() {
+    while (!stopping_notification_.WaitForNotificationWithTimeout(
+        options_.resolution)) {
+      now_ns_.store(absl::GetCurrentTimeNanos(), std::memory_order_relaxed);
+    }
+  }
+
+  const CoarseClockOptions options_;
+  std::unique_ptr<std::thread> background_thread_;
+  absl::Notification stopping_notification_;
+
+  // Alone on its cache line: it is read by every core and written 1000
+  // times per second.
+  ABSL_CACHELINE_ALIGNED std::atomic<int64_t> now_ns_{0};
+};
+
+// Example: the service from the watchdog example stamps its health on every
+// request, the watchdog compares it with the precise time.
+class MyServiceImpl : public Service {
+ public:
+  explicit MyServiceImpl(const CoarseClock* clock) : clock_(clock) {}
+
+  void HandleRequest(/* ... */) {
+    // ...
+    last_known_healthy_time_ns_.store(clock_->NowNanos(),
+                                      std::memory_order_relaxed);
+  }
+
+  absl::Time last_known_healthy_time() const override {
+    return absl::FromUnixNanos(
+        last_known_healthy_time_ns_.load(std::memory_order_relaxed));
+  }
+
+  // Omitted: Start(), Stop() and healthy().
+
+ private:
+  const CoarseClock* clock_;  // Not owned.
+  std::atomic<int64_t> last_known_healthy_time_ns_{0};
+};
+// --8<-- [end:code]
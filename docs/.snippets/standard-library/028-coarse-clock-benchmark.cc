@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+void BM_AbslNow(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(absl::Now());
+  }
+}
+BENCHMARK(BM_AbslNow);
+
+void BM_ClockGettime(benchmark::State& state) {
+  timespec ts;
+  for (auto _ : state) {
+    clock_gettime(CLOCK_REALTIME, &ts);
+    benchmark::DoNotOptimize(ts);
+  }
+}
+BENCHMARK(BM_ClockGettime);
+
+// The kernel's own coarse clock: no ticker thread, but the resolution is a
+// scheduler tick (1 to 10 ms, see |clock_getres()|).
+void BM_ClockGettimeCoarse(benchmark::State& state) {
+  timespec ts;
+  for (auto _ : state) {
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    benchmark::DoNotOptimize(ts);
+  }
+}
+BENCHMARK(BM_ClockGettimeCoarse);
+
+void BM_CoarseClockNow(benchmark::State& state) {
+  CoarseClock clock;
+  CHECK_OK(clock.Start());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(clock.Now());
+  }
+  CHECK_OK(clock.Stop());
+}
+BENCHMARK(BM_CoarseClockNow);
+
+// How far |Now()| lags |absl::Now()|, sampled at random times. With
+// |busy_threads| threads spinning on every core, the ticker has to wait for
+// the scheduler.
+void PrintCoarseClockLag(absl::Duration resolution, int busy_threads) {
+  CoarseClock clock(CoarseClockOptions{.resolution = resolution});
+  CHECK_OK(clock.Start());
+  std::atomic<bool> stopping{false};
+  std::vector<std::thread> busy;
+  for (int i = 0; i < busy_threads; ++i) {
+    busy.emplace_back([&]() {
+      while (!stopping.load(std::memory_order_relaxed)) {
+      }
+    });
+  }
+
+  constexpr int kSamples = 10000;
+  std::vector<int64_t> lags_ns(kSamples);
+  absl::BitGen gen;
+  for (int64_t& lag : lags_ns) {
+    absl::SleepFor(absl::Microseconds(absl::Uniform(gen, 0, 500)));
+    const int64_t coarse = clock.NowNanos();
+    lag = absl::GetCurrentTimeNanos() - coarse;
+  }
+  stopping.store(true);
+  for (std::thread& t : busy) {
+    t.join();
+  }
+  CHECK_OK(clock.Stop());
+
+  std::sort(lags_ns.begin(), lags_ns.end());
+  absl::PrintF("resolution=%s busy_threads=%d: p50=%dus p99=%dus max=%dus\n",
+               absl::FormatDuration(resolution), busy_threads,
+               lags_ns[kSamples / 2] / 1000,
+               lags_ns[kSamples * 99 / 100] / 1000, lags_ns.back() / 1000);
+}
+// --8<-- [end:code]
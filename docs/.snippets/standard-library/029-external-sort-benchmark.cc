@@ -0,0 +1,68 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// The payload: floor and weight, then the name.
+void SerializeRecord(const Record& record, std::string* out) {
+  out->append(reinterpret_cast<const char*>(&record.floor),
+              sizeof(record.floor));
+  out->append(reinterpret_cast<const char*>(&record.weight),
+              sizeof(record.weight));
+  out->append(record.name);
+}
+
+bool ParseRecord(absl::string_view payload, Record* record) {
+  constexpr size_t kFixedSize = sizeof(record->floor) + sizeof(record->weight);
+  if (payload.size() < kFixedSize) {
+    return false;
+  }
+  std::memcpy(&record->floor, payload.data(), sizeof(record->floor));
+  std::memcpy(&record->weight, payload.data() + sizeof(record->floor),
+              sizeof(record->weight));
+  record->name = std::string(payload.substr(kFixedSize));
+  return true;
+}
+
+// Writes random records of 37 bytes each, up to |bytes|, and evicts the file
+// from the page cache, so that the sort reads it from the disk.
+absl::StatusOr<File> WriteRandomRecords(const std::string& dir, size_t bytes) {
+  absl::StatusOr<File> file = CreateTempFile(dir);
+  if (!file.ok()) {
+    return file.status();
+  }
+  std::mt19937_64 gen(42);
+  RunWriter writer(*std::move(file), size_t{4} << 20);
+  for (size_t written = 0; written < bytes; written += 37) {
+    const Record record{absl::StrFormat("user-%016x", gen()),
+                        static_cast<unsigned int>(gen() % 100),
+                        static_cast<double>(gen() % 1000) / 10};
+    absl::Status s = writer.Append(record);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  file = writer.Finish();
+  if (file.ok() && (::fsync(file->fd()) != 0 ||
+                    ::posix_fadvise(file->fd(), 0, 0, POSIX_FADV_DONTNEED))) {
+    return IOError("input file", errno);
+  }
+  return file;
+}
+
+void BenchmarkExternalSort(const std::string& dir, size_t bytes,
+                           const ExternalSortOptions& options) {
+  absl::StatusOr<File> input = WriteRandomRecords(dir, bytes);
+  CHECK_OK(input.status());
+  absl::StatusOr<File> output = CreateTempFile(dir);
+  CHECK_OK(output.status());
+
+  const absl::Time start = absl::Now();
+  ExternalSorter sorter(options);
+  CHECK_OK(sorter.Sort(*std::move(input), *std::move(output)));
+  const absl::Duration elapsed = absl::Now() - start;
+  absl::PrintF("Sorted %d MiB in %s: %.1f MiB/s\n", bytes >> 20,
+               absl::FormatDuration(elapsed),
+               (bytes >> 20) / absl::ToDoubleSeconds(elapsed));
+}
+// --8<-- [end:code]
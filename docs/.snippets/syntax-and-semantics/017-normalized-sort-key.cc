@@ -0,0 +1,174 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Encodes values into byte strings whose memcmp order matches |operator<=>|.
+// Compound keys are the concatenation of their fields' keys, in declaration
+// order, which is exactly what a defaulted |operator<=>| compares.
+
+// Unsigned integers: big-endian.
+inline void AppendNormalizedKey(std::string* out, uint32_t v) {
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    out->push_back(static_cast<char>(v >> shift));
+  }
+}
+
+inline void AppendNormalizedKey(std::string* out, uint64_t v) {
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    out->push_back(static_cast<char>(v >> shift));
+  }
+}
+
+// Doubles: flip all bits of negative numbers, only the sign bit of positive
+// ones. -0.0 is encoded as +0.0 because they compare equal. NaN is unordered
+// for |<=>|, we put every NaN after +inf.
+inline void AppendNormalizedKey(std::string* out, double d) {
+  uint64_t bits = ~uint64_t{0};
+  if (!std::isnan(d)) {
+    bits = bit_cast<uint64_t>(d == 0.0 ? 0.0 : d);
+    bits = (bits >> 63) ? ~bits : bits | (uint64_t{1} << 63);
+  }
+  AppendNormalizedKey(out, bits);
+}
+
+// Strings: escape 0x00 as 0x00 0xFF and terminate with 0x00 0x00, so that a
+// prefix sorts before any of its extensions, and the next field's key cannot
+// change the order.
+inline void AppendNormalizedKey(std::string* out, absl::string_view s) {
+  for (char c : s) {
+    out->push_back(c);
+    if (c == '\0') {
+      out->push_back('\xff');
+    }
+  }
+  out->append(2, '\0');
+}
+
+template <typename... Fields>
+void AppendNormalizedKeys(std::string* out, const Fields&... fields) {
+  (AppendNormalizedKey(out, fields), ...);
+}
+
+struct Record {
+  std::string name;
+  unsigned int floor;
+  double weight;
+  auto operator<=>(const Record&) const = default;
+
+  // Must list the fields in declaration order, like the defaulted <=>.
+  // Libraries such as Boost.PFR can enumerate aggregate fields automatically.
+  friend void AppendNormalizedKey(std::string* out, const Record& r) {
+    AppendNormalizedKeys(out, r.name, r.floor, r.weight);
+  }
+};
+
+// MSD (most significant digit first) radix sort over normalized keys.
+struct KeyRef {
+  const unsigned char* data;
+  uint32_t size;
+  uint32_t index;  // Position of the original element.
+};
+
+// Comparison sort on the bytes from |depth| on, which |keys| do not share.
+inline void SortSuffixes(absl::Span<KeyRef> keys, size_t depth) {
+  std::sort(keys.begin(), keys.end(),
+            [depth](const KeyRef& a, const KeyRef& b) {
+              return std::lexicographical_compare(
+                  a.data + depth, a.data + a.size, b.data + depth,
+                  b.data + b.size);
+            });
+}
+
+// Small buckets: comparison sort on the remaining suffix is faster.
+constexpr size_t kMinRadixBucketSize = 64;
+// Keys which still share this many bytes, e.g. URLs of one site, go to
+// |SortSuffixes()| as well: one pass per shared byte would cost more than
+// comparing them.
+constexpr size_t kMaxRadixDepth = 64;
+
+// Buckets wait on an explicit stack rather than the call stack, which a long
+// common prefix would overflow with one frame per byte.
+inline void MsdRadixSort(absl::Span<KeyRef> keys,
+                         std::vector<KeyRef>* scratch) {
+  // |size| keys from |begin| on, which share their first |depth| bytes.
+  struct Bucket {
+    size_t begin;
+    size_t size;
+    size_t depth;
+  };
+  std::vector<Bucket> stack = {{0, keys.size(), 0}};
+  while (!stack.empty()) {
+    const Bucket bucket = stack.back();
+    stack.pop_back();
+    const absl::Span<KeyRef> part = keys.subspan(bucket.begin, bucket.size);
+    const size_t depth = bucket.depth;
+    if (part.size() < kMinRadixBucketSize || depth >= kMaxRadixDepth) {
+      SortSuffixes(part, depth);
+      continue;
+    }
+
+    // Bucket 0 holds keys which end at |depth|, bucket b + 1 holds byte b.
+    std::array<size_t, 258> offsets{};
+    auto index = [depth](const KeyRef& k) -> size_t {
+      return depth < k.size ? size_t{k.data[depth]} + 1 : 0;
+    };
+    for (const KeyRef& k : part) {
+      ++offsets[index(k) + 1];
+    }
+    for (size_t b = 1; b < offsets.size(); ++b) {
+      offsets[b] += offsets[b - 1];
+    }
+    scratch->resize(part.size());
+    std::array<size_t, 258> next = offsets;
+    for (const KeyRef& k : part) {
+      (*scratch)[next[index(k)]++] = k;
+    }
+    std::copy(scratch->begin(), scratch->end(), part.begin());
+
+    // Bucket 0 keys are all equal, the rest continue with the next byte.
+    for (size_t b = 1; b < 257; ++b) {
+      if (offsets[b + 1] - offsets[b] > 1) {
+        stack.push_back({bucket.begin + offsets[b],
+                         offsets[b + 1] - offsets[b], depth + 1});
+      }
+    }
+  }
+}
+
+// Sorts like |std::sort(records.begin(), records.end())|, but compares each
+// record's fields only once, while encoding.
+//
+// Example:
+//   std::vector<Record> records = LoadRecords();
+//   SortByNormalizedKey(&records);
+template <typename T>
+void SortByNormalizedKey(std::vector<T>* elements) {
+  std::string arena;
+  std::vector<size_t> offsets;
+  offsets.reserve(elements->size() + 1);
+  for (const T& e : *elements) {
+    offsets.push_back(arena.size());
+    AppendNormalizedKey(&arena, e);
+  }
+  offsets.push_back(arena.size());
+
+  // Take pointers only after |arena| stopped growing.
+  const auto* base = reinterpret_cast<const unsigned char*>(arena.data());
+  std::vector<KeyRef> keys(elements->size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = {base + offsets[i],
+               static_cast<uint32_t>(offsets[i + 1] - offsets[i]),
+               static_cast<uint32_t>(i)};
+  }
+  std::vector<KeyRef> scratch;
+  MsdRadixSort(absl::MakeSpan(keys), &scratch);
+
+  std::vector<T> sorted;
+  sorted.reserve(elements->size());
+  for (const KeyRef& k : keys) {
+    sorted.push_back(std::move((*elements)[k.index]));
+  }
+  *elements = std::move(sorted);
+}
+// --8<-- [end:code]
@@ -0,0 +1,231 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// A hash map only finds a |Circle| equal to the key. To find the circles
+// around a point or a region without scanning all of them, index their
+// bounding boxes in a packed R-tree: entries are sorted once so that
+// neighbours end up in the same node, and every level is a flat array.
+//
+// |Circle| has the |center()| and |radius()| accessors elided above.
+// Coordinates and radii must fit in 30 bits, so squared distances fit in
+// int64_t.
+struct Box {
+  int64_t min_x, min_y, max_x, max_y;
+
+  bool Overlaps(const Box& o) const {
+    return min_x <= o.max_x && o.min_x <= max_x && min_y <= o.max_y &&
+           o.min_y <= max_y;
+  }
+  // Squared distance from (x, y) to the box, 0 if the point is inside.
+  int64_t SquaredDistance(int64_t x, int64_t y) const {
+    const int64_t dx = x < min_x ? min_x - x : (x > max_x ? x - max_x : 0);
+    const int64_t dy = y < min_y ? min_y - y : (y > max_y ? y - max_y : 0);
+    return dx * dx + dy * dy;
+  }
+};
+
+class CircleIndex {
+ public:
+  // Circles are identified by their insertion order: the first circle ever
+  // inserted has id 0. Ids stay valid across rebuilds.
+  using Id = uint32_t;
+
+  CircleIndex() = default;
+  explicit CircleIndex(absl::Span<const Circle> circles) {
+    InsertBatch(circles);
+    Rebuild();
+  }
+
+  // New circles are scanned linearly by queries until the next rebuild, which
+  // happens automatically once they are 1/32 of the indexed ones. Call
+  // |Rebuild()| directly after the last batch of a bulk load.
+  void InsertBatch(absl::Span<const Circle> circles) {
+    for (const Circle& c : circles) {
+      pending_.push_back(MakeEntry(c, static_cast<Id>(num_circles_++)));
+    }
+    if (pending_.size() > kNodeSize && pending_.size() > entries_.size() / 32) {
+      Rebuild();
+    }
+  }
+
+  // Bulk-loads all circles with Sort-Tile-Recursive: sort by x, cut into
+  // vertical slices, sort every slice by y, and pack |kNodeSize| entries per
+  // leaf. Upper levels pack consecutive nodes of the level below.
+  void Rebuild() {
+    entries_.insert(entries_.end(), pending_.begin(), pending_.end());
+    pending_.clear();
+    const size_t num_leaves = (entries_.size() + kNodeSize - 1) / kNodeSize;
+    const size_t num_slices =
+        static_cast<size_t>(std::ceil(std::sqrt(num_leaves)));
+    const size_t slice_size = num_slices * kNodeSize;
+    std::sort(entries_.begin(), entries_.end(),
+              [](const Entry& a, const Entry& b) { return a.x < b.x; });
+    for (size_t begin = 0; begin < entries_.size(); begin += slice_size) {
+      const auto end = entries_.begin() +
+                       std::min(begin + slice_size, entries_.size());
+      std::sort(entries_.begin() + begin, end,
+                [](const Entry& a, const Entry& b) { return a.y < b.y; });
+    }
+
+    levels_.clear();
+    if (entries_.empty()) {
+      return;  // No levels, not even a root: queries check |levels_.empty()|.
+    }
+    std::vector<Box> boxes;
+    boxes.reserve(entries_.size());
+    for (const Entry& e : entries_) {
+      boxes.push_back(BoundingBox(e));
+    }
+    levels_.push_back(std::move(boxes));
+    while (levels_.back().size() > 1) {
+      const std::vector<Box>& children = levels_.back();
+      std::vector<Box> parents;
+      parents.reserve((children.size() + kNodeSize - 1) / kNodeSize);
+      for (size_t i = 0; i < children.size(); i += kNodeSize) {
+        Box box = children[i];
+        for (size_t j = i + 1; j < std::min(i + kNodeSize, children.size());
+             ++j) {
+          box.min_x = std::min(box.min_x, children[j].min_x);
+          box.min_y = std::min(box.min_y, children[j].min_y);
+          box.max_x = std::max(box.max_x, children[j].max_x);
+          box.max_y = std::max(box.max_y, children[j].max_y);
+        }
+        parents.push_back(box);
+      }
+      levels_.push_back(std::move(parents));
+    }
+  }
+
+  // Appends to |out| the ids of the circles which contain (x, y), border
+  // included.
+  void FindContaining(int x, int y, std::vector<Id>* out) const {
+    auto contains = [x, y](const Entry& e) {
+      const int64_t dx = int64_t{e.x} - x;
+      const int64_t dy = int64_t{e.y} - y;
+      return dx * dx + dy * dy <= int64_t{e.radius} * e.radius;
+    };
+    Search(Box{x, y, x, y}, contains, out);
+  }
+
+  // Appends to |out| the ids of the circles which overlap |region|.
+  void FindOverlapping(const Box& region, std::vector<Id>* out) const {
+    auto overlaps = [&region](const Entry& e) {
+      return region.SquaredDistance(e.x, e.y) <= int64_t{e.radius} * e.radius;
+    };
+    Search(region, overlaps, out);
+  }
+
+  // Returns the ids of the |k| circles closest to (x, y), closest first. The
+  // distance to a circle is the distance to its disk, 0 from inside.
+  std::vector<Id> FindNearest(int x, int y, size_t k) const {
+    // Best-first search: always expand the node or entry with the smallest
+    // lower bound. An entry popped from the queue is closer than anything
+    // left in it.
+    struct Candidate {
+      double distance;
+      int level;  // -1 for an exact entry distance.
+      size_t index;
+      bool operator>(const Candidate& o) const { return distance > o.distance; }
+    };
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        std::greater<Candidate>>
+        queue;
+    auto disk_distance = [x, y](const Entry& e) {
+      const double d = std::hypot(static_cast<double>(e.x) - x,
+                                  static_cast<double>(e.y) - y);
+      return std::max(0.0, d - e.radius);
+    };
+    for (size_t i = 0; i < pending_.size(); ++i) {
+      queue.push({disk_distance(pending_[i]), -1,
+                  entries_.size() + i});  // Past the indexed entries.
+    }
+    if (!levels_.empty()) {
+      const int root = static_cast<int>(levels_.size()) - 1;
+      queue.push({0.0, root, 0});
+    }
+
+    std::vector<Id> result;
+    while (!queue.empty() && result.size() < k) {
+      const Candidate c = queue.top();
+      queue.pop();
+      if (c.level < 0) {
+        result.push_back(c.index < entries_.size()
+                             ? entries_[c.index].id
+                             : pending_[c.index - entries_.size()].id);
+      } else if (c.level == 0) {
+        queue.push({disk_distance(entries_[c.index]), -1, c.index});
+      } else {
+        const std::vector<Box>& children = levels_[c.level - 1];
+        const size_t end = std::min((c.index + 1) * kNodeSize, children.size());
+        for (size_t i = c.index * kNodeSize; i < end; ++i) {
+          queue.push({std::sqrt(static_cast<double>(
+                          children[i].SquaredDistance(x, y))),
+                      c.level - 1, i});
+        }
+      }
+    }
+    return result;
+  }
+
+  size_t size() const { return num_circles_; }
+
+ private:
+  static constexpr size_t kNodeSize = 16;
+
+  // A copy of the circle, stored in tree order so that leaves are scanned
+  // sequentially.
+  struct Entry {
+    int32_t x, y, radius;
+    Id id;
+  };
+
+  static Entry MakeEntry(const Circle& c, Id id) {
+    return {c.center().first, c.center().second, c.radius(), id};
+  }
+  static Box BoundingBox(const Entry& e) {
+    return {int64_t{e.x} - e.radius, int64_t{e.y} - e.radius,
+            int64_t{e.x} + e.radius, int64_t{e.y} + e.radius};
+  }
+
+  template <typename Predicate>
+  void Search(const Box& query, Predicate matches,
+              std::vector<Id>* out) const {
+    for (const Entry& e : pending_) {
+      if (matches(e)) {
+        out->push_back(e.id);
+      }
+    }
+    if (levels_.empty() || !levels_.back()[0].Overlaps(query)) {
+      return;
+    }
+    // (level, index) of the nodes whose box overlaps |query|.
+    std::vector<std::pair<int, size_t>> stack = {
+        {static_cast<int>(levels_.size()) - 1, 0}};
+    while (!stack.empty()) {
+      const auto [level, index] = stack.back();
+      stack.pop_back();
+      if (level == 0) {
+        if (matches(entries_[index])) {
+          out->push_back(entries_[index].id);
+        }
+        continue;
+      }
+      const std::vector<Box>& children = levels_[level - 1];
+      const size_t end = std::min((index + 1) * kNodeSize, children.size());
+      for (size_t i = index * kNodeSize; i < end; ++i) {
+        if (children[i].Overlaps(query)) {
+          stack.emplace_back(level - 1, i);
+        }
+      }
+    }
+  }
+
+  size_t num_circles_ = 0;
+  std::vector<Entry> entries_;  // Indexed, in tree order.
+  std::vector<Entry> pending_;  // Inserted since the last rebuild.
+  // levels_[0][i] bounds entries_[i], levels_.back() holds only the root.
+  std::vector<std::vector<Box>> levels_;
+};
+// --8<-- [end:code]
@@ -0,0 +1,303 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// A hash map shared by many threads. Keys are spread over |num_shards|
+// independent open-addressing tables, each with its own writer lock, so
+// writers to different shards never contend. Readers take no lock at all:
+// every shard has a sequence number (a seqlock) which writers make odd while
+// they modify the table, and a reader retries if the number changed while it
+// was probing.
+//
+// Readers may copy a slot while a writer overwrites it, so |K| and |V| are
+// stored as relaxed atomic words and must be copyable byte by byte: plain
+// values without pointers to owned memory. (|std::pair<int, int>| is not
+// trivially copyable because of its assignment operator, but its copy
+// constructor and destructor are trivial, which is what this needs.)
+template <typename K, typename V, typename Hash = absl::Hash<K>>
+class ConcurrentHashMap {
+  template <typename T>
+  static constexpr bool kIsPlainValue =
+      std::is_trivially_copy_constructible_v<T> &&
+      std::is_trivially_destructible_v<T>;
+  static_assert(kIsPlainValue<K> && kIsPlainValue<V>,
+                "Optimistic reads copy keys and values during writes.");
+
+ public:
+  explicit ConcurrentHashMap(size_t num_shards = 64)
+      : shard_mask_(absl::bit_ceil(num_shards) - 1),
+        shards_(shard_mask_ + 1) {}
+
+  // Returns true if |key| was inserted, false if its value was replaced.
+  bool InsertOrAssign(const K& key, const V& value) {
+    const size_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    absl::MutexLock lock(&shard.mutex);
+    Slot* slot = shard.FindForWrite(key, hash);
+    const bool inserted = slot == nullptr;
+    shard.BeginWrite();
+    if (inserted) {
+      slot = shard.Insert(key, hash);
+    }
+    slot->value.Store(value);
+    shard.EndWrite();
+    return inserted;
+  }
+
+  // Lock-free: never blocks writers, and only retries while a writer is
+  // modifying the same shard.
+  absl::optional<V> Find(const K& key) const {
+    const size_t hash = Hash()(key);
+    const Shard& shard = ShardFor(hash);
+    while (true) {
+      const uint64_t sequence = shard.sequence.load(std::memory_order_acquire);
+      if (sequence & 1) {
+        // A writer is in the middle of a modification. Let it run, it may be
+        // waiting for this core.
+        std::this_thread::yield();
+        continue;
+      }
+      absl::optional<V> value;
+      const Table* table = shard.table.load(std::memory_order_acquire);
+      if (table != nullptr) {
+        const Slot* slot = table->Find(key, hash);
+        if (slot != nullptr) {
+          value = slot->value.Load();
+        }
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (shard.sequence.load(std::memory_order_relaxed) == sequence) {
+        return value;
+      }
+    }
+  }
+
+  // Returns true if |key| was present.
+  bool Erase(const K& key) {
+    const size_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    absl::MutexLock lock(&shard.mutex);
+    Slot* slot = shard.FindForWrite(key, hash);
+    if (slot == nullptr) {
+      return false;
+    }
+    shard.BeginWrite();
+    slot->control.store(kDeleted, std::memory_order_relaxed);
+    --shard.size;
+    shard.EndWrite();
+    return true;
+  }
+
+  // Read-modify-write of a single entry: calls |update(V&)| on a copy of the
+  // value under the shard lock and stores the result if it returns true.
+  // Readers are not blocked while |update| runs, only while the result is
+  // stored. Returns whether the value was updated.
+  template <typename F>
+  bool UpdateIf(const K& key, F update) {
+    const size_t hash = Hash()(key);
+    Shard& shard = ShardFor(hash);
+    absl::MutexLock lock(&shard.mutex);
+    Slot* slot = shard.FindForWrite(key, hash);
+    if (slot == nullptr) {
+      return false;
+    }
+    V value = slot->value.Load();
+    if (!update(value)) {
+      return false;
+    }
+    shard.BeginWrite();
+    slot->value.Store(value);
+    shard.EndWrite();
+    return true;
+  }
+
+ private:
+  // A |T| stored as relaxed atomic words, so that a concurrent copy is not a
+  // data race. The seqlock tells the reader whether the copy is consistent.
+  template <typename T>
+  class AtomicValue {
+   public:
+    T Load() const {
+      uint64_t words[kWords];
+      for (size_t i = 0; i < kWords; ++i) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      alignas(T) unsigned char bytes[sizeof(T)];
+      std::memcpy(bytes, words, sizeof(T));
+      return *std::launder(reinterpret_cast<T*>(bytes));
+    }
+    void Store(const T& value) {
+      uint64_t words[kWords] = {};
+      std::memcpy(words, &value, sizeof(T));
+      for (size_t i = 0; i < kWords; ++i) {
+        words_[i].store(words[i], std::memory_order_relaxed);
+      }
+    }
+
+   private:
+    static constexpr size_t kWords = (sizeof(T) + 7) / 8;
+    std::atomic<uint64_t> words_[kWords];
+  };
+
+  // Control byte of a slot: empty, deleted (a tombstone, probing continues
+  // past it) or full with 7 bits of the hash, which rule out most key
+  // comparisons.
+  static constexpr uint8_t kEmpty = 0;
+  static constexpr uint8_t kDeleted = 1;
+  static uint8_t FullControl(size_t hash) {
+    return static_cast<uint8_t>(0x80 | (hash >> 57));
+  }
+
+  struct Slot {
+    std::atomic<uint8_t> control{kEmpty};
+    AtomicValue<K> key;
+    AtomicValue<V> value;
+  };
+
+  struct Table {
+    explicit Table(size_t capacity)
+        : mask(capacity - 1), slots(std::make_unique<Slot[]>(capacity)) {}
+
+    // Linear probing. Bounded by the capacity, because a reader racing with
+    // a writer may see a table without any empty slot.
+    const Slot* Find(const K& key, size_t hash) const {
+      const uint8_t control = FullControl(hash);
+      for (size_t i = hash, n = 0; n <= mask; ++i, ++n) {
+        const Slot& slot = slots[i & mask];
+        const uint8_t c = slot.control.load(std::memory_order_relaxed);
+        if (c == kEmpty) {
+          return nullptr;
+        }
+        if (c == control && slot.key.Load() == key) {
+          return &slot;
+        }
+      }
+      return nullptr;
+    }
+
+    const size_t mask;
+    const std::unique_ptr<Slot[]> slots;
+  };
+
+  struct ABSL_CACHELINE_ALIGNED Shard {
+    void BeginWrite() {
+      sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    void EndWrite() {
+      sequence.store(sequence.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+    }
+
+    Slot* FindForWrite(const K& key, size_t hash)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+      const Table* t = table.load(std::memory_order_relaxed);
+      return t == nullptr ? nullptr : const_cast<Slot*>(t->Find(key, hash));
+    }
+
+    // Must be called between |BeginWrite()| and |EndWrite()|, |key| must not
+    // be present.
+    Slot* Insert(const K& key, size_t hash)
+        ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+      Table* t = table.load(std::memory_order_relaxed);
+      // Keep at least 1/8 of the slots empty, tombstones count as used. When
+      // mostly tombstones fill the table, it is cleaned up in place instead
+      // of growing.
+      if (t == nullptr || (used + 1) * 8 > (t->mask + 1) * 7) {
+        const size_t capacity =
+            std::max<size_t>(16, absl::bit_ceil((size + 1) * 2));
+        if (t != nullptr && capacity <= t->mask + 1) {
+          DropTombstones(t);
+        } else {
+          t = Rehash(capacity);
+        }
+      }
+      size_t i = hash;
+      while (t->slots[i & t->mask].control.load(std::memory_order_relaxed) >
+             kDeleted) {
+        ++i;
+      }
+      Slot* slot = &t->slots[i & t->mask];
+      if (slot->control.load(std::memory_order_relaxed) == kEmpty) {
+        ++used;
+      }
+      slot->key.Store(key);
+      slot->control.store(FullControl(hash), std::memory_order_relaxed);
+      ++size;
+      return slot;
+    }
+
+    // Readers may still be probing the old table. It is kept, not freed, until
+    // the map is destroyed. Tables are only replaced by tables twice as large,
+    // so all retired tables together are smaller than the current one.
+    Table* Rehash(size_t capacity) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+      auto fresh = std::make_unique<Table>(capacity);
+      if (const Table* old = table.load(std::memory_order_relaxed)) {
+        for (size_t i = 0; i <= old->mask; ++i) {
+          const Slot& from = old->slots[i];
+          if (from.control.load(std::memory_order_relaxed) > kDeleted) {
+            Place(fresh.get(), from.key.Load(), from.value.Load());
+          }
+        }
+      }
+      used = size;
+      table.store(fresh.get(), std::memory_order_release);
+      tables.push_back(std::move(fresh));
+      return tables.back().get();
+    }
+
+    // Must be called between |BeginWrite()| and |EndWrite()|: readers probing
+    // |t| meanwhile retry.
+    void DropTombstones(Table* t) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+      std::vector<std::pair<K, V>> entries;
+      entries.reserve(size);
+      for (size_t i = 0; i <= t->mask; ++i) {
+        Slot& slot = t->slots[i];
+        if (slot.control.load(std::memory_order_relaxed) > kDeleted) {
+          entries.emplace_back(slot.key.Load(), slot.value.Load());
+        }
+        slot.control.store(kEmpty, std::memory_order_relaxed);
+      }
+      for (const auto& [key, value] : entries) {
+        Place(t, key, value);
+      }
+      used = size;
+    }
+
+    // Stores an entry which is not present into the first empty slot.
+    static void Place(Table* t, const K& key, const V& value) {
+      const size_t hash = Hash()(key);
+      size_t i = hash;
+      while (t->slots[i & t->mask].control.load(std::memory_order_relaxed) !=
+             kEmpty) {
+        ++i;
+      }
+      Slot& slot = t->slots[i & t->mask];
+      slot.key.Store(key);
+      slot.value.Store(value);
+      slot.control.store(FullControl(hash), std::memory_order_relaxed);
+    }
+
+    absl::Mutex mutex;
+    std::atomic<uint64_t> sequence{0};  // Odd while a write is in progress.
+    std::atomic<Table*> table{nullptr};
+    size_t size ABSL_GUARDED_BY(mutex) = 0;
+    size_t used ABSL_GUARDED_BY(mutex) = 0;  // Full and deleted slots.
+    std::vector<std::unique_ptr<Table>> tables ABSL_GUARDED_BY(mutex);
+  };
+
+  Shard& ShardFor(size_t hash) { return shards_[(hash >> 32) & shard_mask_]; }
+  const Shard& ShardFor(size_t hash) const {
+    return shards_[(hash >> 32) & shard_mask_];
+  }
+
+  const size_t shard_mask_;
+  std::vector<Shard> shards_;
+};
+
+// Replaces |std::unordered_map<Circle, MyValue, absl::Hash<Circle>>| plus a
+// mutex, as long as |MyValue| is a plain value too.
+ConcurrentHashMap<Circle, MyValue> my_concurrent_map;
+// --8<-- [end:code]
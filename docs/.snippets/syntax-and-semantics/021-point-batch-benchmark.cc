@@ -0,0 +1,113 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Coordinates in a small range, so that many points share an x and the
+// comparisons also look at y.
+std::vector<Point> RandomPoints(size_t n, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int32_t> coordinate(-1000, 1000);
+  std::vector<Point> points;
+  points.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    const int32_t x = coordinate(gen);
+    points.emplace_back(x, coordinate(gen));
+  }
+  return points;
+}
+
+// 1K points (8 KiB, in L1) and 1M points (8 MiB, beyond L2).
+void PointCounts(benchmark::internal::Benchmark* b) {
+  b->Arg(1 << 10)->Arg(1 << 20);
+}
+
+void BM_AddAoS(benchmark::State& state) {
+  std::vector<Point> points = RandomPoints(state.range(0), 1);
+  for (auto _ : state) {
+    for (Point& p : points) {
+      p = p + 1;
+    }
+    benchmark::DoNotOptimize(points.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_AddAoS)->Apply(PointCounts);
+
+void BM_AddSoA(benchmark::State& state) {
+  PointBatch batch(RandomPoints(state.range(0), 1));
+  for (auto _ : state) {
+    batch += 1;
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(BM_AddSoA)->Apply(PointCounts);
+
+void BM_LessThanAoS(benchmark::State& state) {
+  const std::vector<Point> a = RandomPoints(state.range(0), 1);
+  const std::vector<Point> b = RandomPoints(state.range(0), 2);
+  std::vector<uint8_t> out(a.size());
+  for (auto _ : state) {
+    for (size_t i = 0; i < a.size(); ++i) {
+      out[i] = a[i] < b[i];
+    }
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * a.size());
+}
+BENCHMARK(BM_LessThanAoS)->Apply(PointCounts);
+
+void BM_LessThanSoA(benchmark::State& state) {
+  const PointBatch a(RandomPoints(state.range(0), 1));
+  const PointBatch b(RandomPoints(state.range(0), 2));
+  std::vector<uint8_t> out(a.size());
+  for (auto _ : state) {
+    a.LessThan(b, absl::MakeSpan(out));
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * a.size());
+}
+BENCHMARK(BM_LessThanSoA)->Apply(PointCounts);
+
+// Sorts a fresh copy of the same points per iteration; the copy is not timed.
+void BM_SortAoS(benchmark::State& state) {
+  const std::vector<Point> points = RandomPoints(state.range(0), 1);
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Point> copy = points;
+    state.ResumeTiming();
+    std::sort(copy.begin(), copy.end());
+    benchmark::DoNotOptimize(copy.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_SortAoS)->Apply(PointCounts);
+
+void BM_SortSoA(benchmark::State& state) {
+  const PointBatch batch(RandomPoints(state.range(0), 1));
+  for (auto _ : state) {
+    state.PauseTiming();
+    PointBatch copy = batch;
+    state.ResumeTiming();
+    copy.Sort();
+    benchmark::DoNotOptimize(copy[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(BM_SortSoA)->Apply(PointCounts);
+
+// The price of switching layouts: one |PointBatch| from the points and back.
+void BM_ConvertAoSToSoAAndBack(benchmark::State& state) {
+  const std::vector<Point> points = RandomPoints(state.range(0), 1);
+  for (auto _ : state) {
+    const PointBatch batch(points);
+    benchmark::DoNotOptimize(batch.ToPoints());
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_ConvertAoSToSoAAndBack)->Apply(PointCounts);
+// --8<-- [end:code]
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// The baseline: one mutex in front of a |std::unordered_map|, with the same
+// interface as |ConcurrentHashMap|.
+template <typename K, typename V>
+class MutexHashMap {
+ public:
+  bool InsertOrAssign(const K& key, const V& value) {
+    absl::MutexLock lock(&mutex_);
+    return map_.insert_or_assign(key, value).second;
+  }
+  absl::optional<V> Find(const K& key) const {
+    absl::MutexLock lock(&mutex_);
+    auto it = map_.find(key);
+    return it == map_.end() ? absl::nullopt : absl::optional<V>(it->second);
+  }
+  bool Erase(const K& key) {
+    absl::MutexLock lock(&mutex_);
+    return map_.erase(key) == 1;
+  }
+
+ private:
+  mutable absl::Mutex mutex_;
+  std::unordered_map<K, V, absl::Hash<K>> map_ ABSL_GUARDED_BY(mutex_);
+};
+
+constexpr int64_t kKeys = 1 << 16;
+
+// Both maps start with every key present and are shared by all threads of
+// all runs.
+template <typename Map>
+Map& SharedMap() {
+  static Map* map = [] {
+    auto* m = new Map();
+    for (int64_t key = 0; key < kKeys; ++key) {
+      m->InsertOrAssign(key, key);
+    }
+    return m;
+  }();
+  return *map;
+}
+
+// |write_percent| of the operations are writes, half of them erasing a key
+// and half inserting one, so the number of keys stays about the same.
+template <typename Map>
+void RunMix(benchmark::State& state, int write_percent) {
+  Map& map = SharedMap<Map>();
+  std::mt19937_64 gen(state.thread_index());
+  for (auto _ : state) {
+    const uint64_t r = gen();
+    const int64_t key = static_cast<int64_t>(r % kKeys);
+    const int op = static_cast<int>((r >> 32) % 200);
+    if (op >= 2 * write_percent) {
+      benchmark::DoNotOptimize(map.Find(key));
+    } else if (op % 2 == 0) {
+      map.Erase(key);
+    } else {
+      map.InsertOrAssign(key, key);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// 95% reads.
+void BM_ReadMostlyMutex(benchmark::State& state) {
+  RunMix<MutexHashMap<int64_t, int64_t>>(state, 5);
+}
+BENCHMARK(BM_ReadMostlyMutex)->ThreadRange(1, 64)->UseRealTime();
+
+void BM_ReadMostlyConcurrent(benchmark::State& state) {
+  RunMix<ConcurrentHashMap<int64_t, int64_t>>(state, 5);
+}
+BENCHMARK(BM_ReadMostlyConcurrent)->ThreadRange(1, 64)->UseRealTime();
+
+// 50% writes.
+void BM_WriteHeavyMutex(benchmark::State& state) {
+  RunMix<MutexHashMap<int64_t, int64_t>>(state, 50);
+}
+BENCHMARK(BM_WriteHeavyMutex)->ThreadRange(1, 64)->UseRealTime();
+
+void BM_WriteHeavyConcurrent(benchmark::State& state) {
+  RunMix<ConcurrentHashMap<int64_t, int64_t>>(state, 50);
+}
+BENCHMARK(BM_WriteHeavyConcurrent)->ThreadRange(1, 64)->UseRealTime();
+// --8<-- [end:code]
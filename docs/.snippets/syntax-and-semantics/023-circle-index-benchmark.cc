@@ -0,0 +1,159 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// |Circle| also has a constructor from x, y and radius, elided above.
+constexpr size_t kNumCircles = 10'000'000;
+constexpr int kCoordinateRange = 1'000'000;
+constexpr int kMaxRadius = 2000;
+constexpr int kRegionSize = 1000;
+
+// Centers uniform in [-1M, 1M]^2 and radii in [0, 2000]: a point is inside
+// about 10 circles, and a 1000 x 1000 region overlaps about 23.
+struct CircleData {
+  std::vector<Circle> circles;
+  CircleIndex index;
+  std::vector<std::pair<int, int>> query_points;
+};
+
+// Built once and shared by all benchmarks: the bulk load takes seconds.
+const CircleData& SharedCircles() {
+  static const CircleData* data = [] {
+    auto* d = new CircleData();
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> position(-kCoordinateRange,
+                                                kCoordinateRange);
+    std::uniform_int_distribution<int> radius(0, kMaxRadius);
+    d->circles.reserve(kNumCircles);
+    for (size_t i = 0; i < kNumCircles; ++i) {
+      const int x = position(gen);
+      const int y = position(gen);
+      d->circles.emplace_back(x, y, radius(gen));
+    }
+    d->index = CircleIndex(d->circles);
+    for (int i = 0; i < 1024; ++i) {
+      const int x = position(gen);
+      d->query_points.emplace_back(x, position(gen));
+    }
+    return d;
+  }();
+  return *data;
+}
+
+// The baselines: one pass over all circles per query.
+void ScanContaining(absl::Span<const Circle> circles, int x, int y,
+                    std::vector<CircleIndex::Id>* out) {
+  for (size_t i = 0; i < circles.size(); ++i) {
+    const Circle& c = circles[i];
+    const int64_t dx = int64_t{c.center().first} - x;
+    const int64_t dy = int64_t{c.center().second} - y;
+    if (dx * dx + dy * dy <= int64_t{c.radius()} * c.radius()) {
+      out->push_back(static_cast<CircleIndex::Id>(i));
+    }
+  }
+}
+
+void ScanOverlapping(absl::Span<const Circle> circles, const Box& region,
+                     std::vector<CircleIndex::Id>* out) {
+  for (size_t i = 0; i < circles.size(); ++i) {
+    const Circle& c = circles[i];
+    if (region.SquaredDistance(c.center().first, c.center().second) <=
+        int64_t{c.radius()} * c.radius()) {
+      out->push_back(static_cast<CircleIndex::Id>(i));
+    }
+  }
+}
+
+double DiskDistance(const Circle& c, int x, int y) {
+  const double d = std::hypot(static_cast<double>(c.center().first) - x,
+                              static_cast<double>(c.center().second) - y);
+  return std::max(0.0, d - c.radius());
+}
+
+std::vector<CircleIndex::Id> ScanNearest(absl::Span<const Circle> circles,
+                                         int x, int y, size_t k) {
+  // The |k| closest so far, the farthest of them on top.
+  std::priority_queue<std::pair<double, CircleIndex::Id>> closest;
+  for (size_t i = 0; i < circles.size(); ++i) {
+    const double distance = DiskDistance(circles[i], x, y);
+    if (closest.size() < k || distance < closest.top().first) {
+      closest.emplace(distance, static_cast<CircleIndex::Id>(i));
+      if (closest.size() > k) {
+        closest.pop();
+      }
+    }
+  }
+  std::vector<CircleIndex::Id> result(closest.size());
+  for (size_t i = result.size(); i > 0; --i) {
+    result[i - 1] = closest.top().second;
+    closest.pop();
+  }
+  return result;
+}
+
+// Runs |query(x, y)| on a different random point every iteration.
+template <typename Query>
+void RunQueries(benchmark::State& state, Query query) {
+  const CircleData& data = SharedCircles();
+  size_t next = 0;
+  for (auto _ : state) {
+    const auto [x, y] = data.query_points[next++ % data.query_points.size()];
+    query(data, x, y);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ContainingIndex(benchmark::State& state) {
+  RunQueries(state, [](const CircleData& data, int x, int y) {
+    std::vector<CircleIndex::Id> ids;
+    data.index.FindContaining(x, y, &ids);
+    benchmark::DoNotOptimize(ids.data());
+  });
+}
+BENCHMARK(BM_ContainingIndex)->Unit(benchmark::kMicrosecond);
+
+void BM_ContainingScan(benchmark::State& state) {
+  RunQueries(state, [](const CircleData& data, int x, int y) {
+    std::vector<CircleIndex::Id> ids;
+    ScanContaining(data.circles, x, y, &ids);
+    benchmark::DoNotOptimize(ids.data());
+  });
+}
+BENCHMARK(BM_ContainingScan)->Unit(benchmark::kMicrosecond);
+
+void BM_OverlappingIndex(benchmark::State& state) {
+  RunQueries(state, [](const CircleData& data, int x, int y) {
+    std::vector<CircleIndex::Id> ids;
+    data.index.FindOverlapping(
+        Box{x, y, int64_t{x} + kRegionSize, int64_t{y} + kRegionSize}, &ids);
+    benchmark::DoNotOptimize(ids.data());
+  });
+}
+BENCHMARK(BM_OverlappingIndex)->Unit(benchmark::kMicrosecond);
+
+void BM_OverlappingScan(benchmark::State& state) {
+  RunQueries(state, [](const CircleData& data, int x, int y) {
+    std::vector<CircleIndex::Id> ids;
+    ScanOverlapping(
+        data.circles,
+        Box{x, y, int64_t{x} + kRegionSize, int64_t{y} + kRegionSize}, &ids);
+    benchmark::DoNotOptimize(ids.data());
+  });
+}
+BENCHMARK(BM_OverlappingScan)->Unit(benchmark::kMicrosecond);
+
+void BM_NearestIndex(benchmark::State& state) {
+  RunQueries(state, [](const CircleData& data, int x, int y) {
+    benchmark::DoNotOptimize(data.index.FindNearest(x, y, 10));
+  });
+}
+BENCHMARK(BM_NearestIndex)->Unit(benchmark::kMicrosecond);
+
+void BM_NearestScan(benchmark::State& state) {
+  RunQueries(state, [](const CircleData& data, int x, int y) {
+    benchmark::DoNotOptimize(ScanNearest(data.circles, x, y, 10));
+  });
+}
+BENCHMARK(BM_NearestScan)->Unit(benchmark::kMicrosecond);
+// --8<-- [end:code]
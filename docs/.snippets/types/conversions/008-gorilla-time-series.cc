@@ -0,0 +1,236 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Compresses a stream of (timestamp, value) samples the way Facebook's Gorilla
+// TSDB does: http://www.vldb.org/pvldb/vol8/p1816-teller.pdf
+//
+// - Timestamps are stored as delta-of-delta. Samples taken at a fixed interval
+//   cost 1 bit each.
+// - Values are XOR-ed with the previous value at the bit level (this is where
+//   |bit_cast| comes in). Slowly changing metrics share sign, exponent and high
+//   mantissa bits, so only a short window of "meaningful" bits is stored.
+
+// Appends bits MSB-first into 64-bit words.
+class BitWriter {
+ public:
+  // Appends the low |n| bits of |bits|, 0 <= n <= 64.
+  void Write(uint64_t bits, int n) {
+    if (n == 0) {
+      return;
+    }
+    if (n < 64) {
+      bits &= (uint64_t{1} << n) - 1;
+    }
+    if (used_ == 64) {
+      words_.push_back(0);
+      used_ = 0;
+    }
+    const int free = 64 - used_;
+    if (n <= free) {
+      words_.back() |= bits << (free - n);
+      used_ += n;
+    } else {
+      words_.back() |= bits >> (n - free);
+      words_.push_back(bits << (64 - (n - free)));
+      used_ = n - free;
+    }
+  }
+
+  absl::Span<const uint64_t> words() const { return words_; }
+  size_t size_in_bytes() const { return words_.size() * sizeof(uint64_t); }
+
+ private:
+  std::vector<uint64_t> words_;
+  int used_{64};  // Bits used in |words_.back()|.
+};
+
+class BitReader {
+ public:
+  explicit BitReader(absl::Span<const uint64_t> words) : words_(words) {}
+
+  // Reads |n| bits, 1 <= n <= 64. The caller must not read past the end.
+  uint64_t Read(int n) {
+    const size_t word = position_ / 64;
+    const int offset = static_cast<int>(position_ % 64);
+    position_ += n;
+    const uint64_t high = words_[word] << offset;
+    if (offset + n <= 64) {
+      return high >> (64 - n);
+    }
+    return (high >> (64 - n)) | (words_[word + 1] >> (128 - offset - n));
+  }
+
+  bool ReadBit() { return Read(1) != 0; }
+
+ private:
+  absl::Span<const uint64_t> words_;
+  size_t position_{0};
+};
+
+class TimeSeriesChunkEncoder {
+ public:
+  // Samples must be appended in non-decreasing |timestamp_ms| order.
+  void Append(int64_t timestamp_ms, double value) {
+    const uint64_t bits = bit_cast<uint64_t>(value);
+    if (count_ == 0) {
+      writer_.Write(static_cast<uint64_t>(timestamp_ms), 64);
+      writer_.Write(bits, 64);
+    } else {
+      AppendTimestamp(timestamp_ms);
+      AppendValue(bits);
+    }
+    previous_timestamp_ = timestamp_ms;
+    previous_bits_ = bits;
+    ++count_;
+  }
+
+  size_t count() const { return count_; }
+  size_t size_in_bytes() const { return writer_.size_in_bytes(); }
+  absl::Span<const uint64_t> data() const { return writer_.words(); }
+
+ private:
+  void AppendTimestamp(int64_t timestamp_ms) {
+    const int64_t delta = timestamp_ms - previous_timestamp_;
+    const int64_t delta_of_delta = delta - previous_delta_;
+    previous_delta_ = delta;
+
+    const uint64_t dod = static_cast<uint64_t>(delta_of_delta);
+    if (delta_of_delta == 0) {
+      writer_.Write(0b0, 1);
+    } else if (delta_of_delta >= -64 && delta_of_delta <= 63) {
+      writer_.Write(0b10, 2);
+      writer_.Write(dod, 7);
+    } else if (delta_of_delta >= -256 && delta_of_delta <= 255) {
+      writer_.Write(0b110, 3);
+      writer_.Write(dod, 9);
+    } else if (delta_of_delta >= -2048 && delta_of_delta <= 2047) {
+      writer_.Write(0b1110, 4);
+      writer_.Write(dod, 12);
+    } else {
+      writer_.Write(0b1111, 4);
+      writer_.Write(dod, 64);
+    }
+  }
+
+  void AppendValue(uint64_t bits) {
+    const uint64_t xor_bits = bits ^ previous_bits_;
+    if (xor_bits == 0) {
+      writer_.Write(0b0, 1);
+      return;
+    }
+    writer_.Write(0b1, 1);
+
+    // The leading zero count must fit in 5 bits.
+    const int leading = std::min(absl::countl_zero(xor_bits), 31);
+    const int trailing = absl::countr_zero(xor_bits);
+    if (leading >= previous_leading_ && trailing >= previous_trailing_) {
+      // Reuse the previous window, no need to store its position.
+      writer_.Write(0b0, 1);
+      writer_.Write(xor_bits >> previous_trailing_,
+                    64 - previous_leading_ - previous_trailing_);
+      return;
+    }
+
+    const int meaningful = 64 - leading - trailing;
+    writer_.Write(0b1, 1);
+    writer_.Write(static_cast<uint64_t>(leading), 5);
+    writer_.Write(static_cast<uint64_t>(meaningful), 6);  // 64 is stored as 0.
+    writer_.Write(xor_bits >> trailing, meaningful);
+    previous_leading_ = leading;
+    previous_trailing_ = trailing;
+  }
+
+  BitWriter writer_;
+  size_t count_{0};
+  int64_t previous_timestamp_{0};
+  int64_t previous_delta_{0};
+  uint64_t previous_bits_{0};
+  // Starts with an impossible window so the first XOR always stores its own.
+  int previous_leading_{64};
+  int previous_trailing_{64};
+};
+
+class TimeSeriesChunkDecoder {
+ public:
+  // |data| and |count| come from |TimeSeriesChunkEncoder|. |data| must outlive
+  // the decoder.
+  TimeSeriesChunkDecoder(absl::Span<const uint64_t> data, size_t count)
+      : reader_(data), remaining_(count) {}
+
+  // Decodes up to |timestamps.size()| samples, returns the number decoded.
+  // Decoding in batches keeps the loop tight and lets the caller reuse its
+  // buffers instead of allocating one object per sample.
+  //
+  // Example:
+  //   TimeSeriesChunkDecoder decoder(encoder.data(), encoder.count());
+  //   std::array<int64_t, 256> timestamps;
+  //   std::array<double, 256> values;
+  //   while (size_t n = decoder.Decode(absl::MakeSpan(timestamps),
+  //                                    absl::MakeSpan(values))) {
+  //     // Consume the first |n| samples...
+  //   }
+  size_t Decode(absl::Span<int64_t> timestamps, absl::Span<double> values) {
+    const size_t n =
+        std::min({remaining_, timestamps.size(), values.size()});
+    for (size_t i = 0; i < n; ++i) {
+      if (first_) {
+        timestamp_ = static_cast<int64_t>(reader_.Read(64));
+        bits_ = reader_.Read(64);
+        first_ = false;
+      } else {
+        delta_ += ReadDeltaOfDelta();
+        timestamp_ += delta_;
+        bits_ ^= ReadXor();
+      }
+      timestamps[i] = timestamp_;
+      values[i] = bit_cast<double>(bits_);
+    }
+    remaining_ -= n;
+    return n;
+  }
+
+ private:
+  static int64_t SignExtend(uint64_t bits, int n) {
+    return static_cast<int64_t>(bits << (64 - n)) >> (64 - n);
+  }
+
+  int64_t ReadDeltaOfDelta() {
+    if (!reader_.ReadBit()) {
+      return 0;
+    }
+    if (!reader_.ReadBit()) {
+      return SignExtend(reader_.Read(7), 7);
+    }
+    if (!reader_.ReadBit()) {
+      return SignExtend(reader_.Read(9), 9);
+    }
+    if (!reader_.ReadBit()) {
+      return SignExtend(reader_.Read(12), 12);
+    }
+    return static_cast<int64_t>(reader_.Read(64));
+  }
+
+  uint64_t ReadXor() {
+    if (!reader_.ReadBit()) {
+      return 0;
+    }
+    if (reader_.ReadBit()) {
+      leading_ = static_cast<int>(reader_.Read(5));
+      const int meaningful = static_cast<int>(reader_.Read(6));
+      trailing_ = 64 - leading_ - (meaningful == 0 ? 64 : meaningful);
+    }
+    return reader_.Read(64 - leading_ - trailing_) << trailing_;
+  }
+
+  BitReader reader_;
+  size_t remaining_;
+  bool first_{true};
+  int64_t timestamp_{0};
+  int64_t delta_{0};
+  uint64_t bits_{0};
+  int leading_{0};
+  int trailing_{0};
+};
+// --8<-- [end:code]
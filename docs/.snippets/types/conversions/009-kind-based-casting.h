@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// LLVM-style RTTI without RTTI, see
+// https://llvm.org/docs/HowToSetUpLLVMStyleRTTI.html
+//
+// The base class stores a |Kind| chosen by the most derived class. Kinds are
+// ordered like a pre-order walk of the class hierarchy, so every subtree
+// occupies a contiguous range and "is |f| a |To|" becomes one or two integer
+// comparisons, no matter how deep the hierarchy is. Each class participating
+// in the scheme provides:
+//
+//   static bool classof(const Base* b);
+//
+// Works with -fno-rtti.
+
+// Copies the const qualifier of |From| onto |To|.
+template <typename To, typename From>
+using copy_const_t =
+    typename std::conditional<std::is_const<From>::value, const To, To>::type;
+
+template <typename To, typename From>
+inline bool isa(const From* f) {
+  assert(f != nullptr);
+  if constexpr (std::is_base_of<To, From>::value) {
+    return true;  // Upcast, always succeeds.
+  } else {
+    return To::classof(f);
+  }
+}
+
+// Checked downcast: asserts in debug mode, a plain |static_cast| otherwise.
+// Use it like |down_cast|, when the program logic already guarantees the type.
+template <typename To, typename From>
+inline copy_const_t<To, From>* cast(From* f) {
+  assert(isa<To>(f));
+  return static_cast<copy_const_t<To, From>*>(f);
+}
+
+// Returns nullptr if |f| is not a |To|. Use it instead of
+// |dynamic_cast<To*>(f)|.
+template <typename To, typename From>
+inline copy_const_t<To, From>* dyn_cast(From* f) {
+  return isa<To>(f) ? static_cast<copy_const_t<To, From>*>(f) : nullptr;
+}
+
+class Animal {
+ public:
+  // Pre-order of the hierarchy. A |kLast*| marker closes every non-leaf class.
+  enum class Kind : uint8_t {
+    kDog,
+    kGuideDog,
+    kSheepDog,
+    kLastDog = kSheepDog,
+    kCat,
+  };
+
+  virtual ~Animal() = default;
+
+  Kind kind() const { return kind_; }
+
+ protected:
+  explicit Animal(Kind kind) : kind_(kind) {}
+
+ private:
+  const Kind kind_;
+};
+
+class Dog : public Animal {
+ public:
+  Dog() : Animal(Kind::kDog) {}
+
+  static bool classof(const Animal* a) {
+    return a->kind() >= Kind::kDog && a->kind() <= Kind::kLastDog;
+  }
+
+ protected:
+  explicit Dog(Kind kind) : Animal(kind) {}
+};
+
+class GuideDog final : public Dog {
+ public:
+  GuideDog() : Dog(Kind::kGuideDog) {}
+
+  static bool classof(const Animal* a) { return a->kind() == Kind::kGuideDog; }
+};
+
+class SheepDog final : public Dog {
+ public:
+  SheepDog() : Dog(Kind::kSheepDog) {}
+
+  static bool classof(const Animal* a) { return a->kind() == Kind::kSheepDog; }
+};
+
+class Cat final : public Animal {
+ public:
+  Cat() : Animal(Kind::kCat) {}
+
+  static bool classof(const Animal* a) { return a->kind() == Kind::kCat; }
+};
+
+// Example:
+//   void Feed(Animal* animal) {
+//     if (Dog* dog = dyn_cast<Dog>(animal)) {  // Also matches GuideDog.
+//       // ...
+//     } else if (isa<Cat>(animal)) {
+//       // ...
+//     }
+//   }
+//
+// Better still, when you need a dispatch on every kind, |switch| on
+// |animal->kind()| and let -Wswitch tell you about unhandled kinds.
+// --8<-- [end:code]
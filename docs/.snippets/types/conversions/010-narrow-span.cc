@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Bulk narrowing conversion from double to int32_t, int16_t or uint8_t.
+//
+// Unlike |narrow_cast|, the behavior for out-of-range values is explicit:
+enum class NarrowMode {
+  // Truncate toward zero like |static_cast|, but stop at the first value
+  // (including NaN) that does not fit in the destination type.
+  kChecked,
+  // Truncate toward zero, clamp to [min, max] of the destination type. NaN
+  // becomes 0.
+  kSaturate,
+  // Like |kSaturate|, but round to nearest (ties to even) instead of
+  // truncating.
+  kRound,
+};
+
+namespace internal {
+
+template <typename T>
+struct NarrowLimits {
+  static constexpr double kMin =
+      static_cast<double>(std::numeric_limits<T>::min());
+  static constexpr double kMax =
+      static_cast<double>(std::numeric_limits<T>::max());
+};
+
+template <typename T>
+inline bool NarrowOne(double d, NarrowMode mode, T* out) {
+  using Limits = NarrowLimits<T>;
+  if (mode == NarrowMode::kChecked) {
+    // Truncation maps (kMin - 1, kMax + 1) into range. NaN fails both tests.
+    if (!(d > Limits::kMin - 1.0 && d < Limits::kMax + 1.0)) {
+      return false;
+    }
+  } else {
+    if (std::isnan(d)) {
+      d = 0.0;
+    }
+    if (mode == NarrowMode::kRound) {
+      d = std::nearbyint(d);
+    }
+    d = std::min(std::max(d, Limits::kMin), Limits::kMax);
+  }
+  *out = static_cast<T>(d);
+  return true;
+}
+
+#if defined(__AVX2__)
+// Stores 4 int32 lanes already known to fit in |T|.
+template <typename T>
+inline void Store4(__m128i v, T* dst) {
+  if constexpr (std::is_same<T, int32_t>::value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+  } else if constexpr (std::is_same<T, int16_t>::value) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packs_epi32(v, v));
+  } else {
+    static_assert(std::is_same<T, uint8_t>::value, "Unsupported type");
+    const __m128i u16 = _mm_packus_epi32(v, v);
+    const int32_t u8 = _mm_cvtsi128_si32(_mm_packus_epi16(u16, u16));
+    std::memcpy(dst, &u8, sizeof(u8));
+  }
+}
+
+// Converts |src[0, n)| 4 lanes at a time, returns the number of elements
+// handled. In |kChecked| mode it stops before the first block containing an
+// out-of-range value and leaves that block to the scalar loop.
+template <typename T>
+size_t NarrowSpanAvx2(const double* src, T* dst, size_t n, NarrowMode mode) {
+  using Limits = NarrowLimits<T>;
+  const __m256d lo = _mm256_set1_pd(Limits::kMin);
+  const __m256d hi = _mm256_set1_pd(Limits::kMax);
+  const __m256d checked_lo = _mm256_set1_pd(Limits::kMin - 1.0);
+  const __m256d checked_hi = _mm256_set1_pd(Limits::kMax + 1.0);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d v = _mm256_loadu_pd(src + i);
+    if (mode == NarrowMode::kChecked) {
+      const __m256d in_range =
+          _mm256_and_pd(_mm256_cmp_pd(v, checked_lo, _CMP_GT_OQ),
+                        _mm256_cmp_pd(v, checked_hi, _CMP_LT_OQ));
+      if (_mm256_movemask_pd(in_range) != 0xF) {
+        break;
+      }
+    } else {
+      v = _mm256_and_pd(v, _mm256_cmp_pd(v, v, _CMP_ORD_Q));  // NaN -> 0.
+      if (mode == NarrowMode::kRound) {
+        v = _mm256_round_pd(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+      }
+      v = _mm256_min_pd(_mm256_max_pd(v, lo), hi);
+    }
+    Store4(_mm256_cvttpd_epi32(v), dst + i);
+  }
+  return i;
+}
+#endif  // defined(__AVX2__)
+
+}  // namespace internal
+
+// Converts |src| into the first |src.size()| elements of |dst|.
+//
+// Returns the number of elements converted. Only |kChecked| mode can stop
+// early, so a return value smaller than |src.size()| is the index of the first
+// out-of-range element.
+//
+// Example:
+//   std::vector<int16_t> features(raw.size());
+//   size_t n = NarrowSpan(raw, absl::MakeSpan(features), NarrowMode::kChecked);
+//   if (n != raw.size()) {
+//     return absl::OutOfRangeError(
+//         absl::StrCat("feature ", n, " out of range: ", raw[n]));
+//   }
+template <typename T>
+size_t NarrowSpan(absl::Span<const double> src, absl::Span<T> dst,
+                  NarrowMode mode) {
+  static_assert(std::is_same<T, int32_t>::value ||
+                    std::is_same<T, int16_t>::value ||
+                    std::is_same<T, uint8_t>::value,
+                "NarrowSpan supports int32_t, int16_t and uint8_t");
+  assert(dst.size() >= src.size());
+
+  size_t i = 0;
+#if defined(__AVX2__)
+  i = internal::NarrowSpanAvx2(src.data(), dst.data(), src.size(), mode);
+#endif
+  for (; i < src.size(); ++i) {
+    if (!internal::NarrowOne(src[i], mode, &dst[i])) {
+      return i;
+    }
+  }
+  return src.size();
+}
+// --8<-- [end:code]
@@ -0,0 +1,187 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+enum class RefCountMode {
+  kAtomic,     // Any thread may copy and release references.
+  kNonAtomic,  // One thread at a time, e.g. objects owned by one shard.
+};
+
+// Base of intrusively reference counted types: the count lives in the object,
+// so there is no separate control block and a |RefPtr| is a single pointer.
+// |T| is the root of the hierarchy. It needs a virtual destructor if objects
+// are released through it while their type is a subclass.
+//
+// Like Chromium's |base::RefCounted| and |base::RefCountedThreadSafe|.
+template <typename T, RefCountMode kMode = RefCountMode::kAtomic>
+class RefCounted {
+ public:
+  RefCounted(const RefCounted&) = delete;
+  RefCounted& operator=(const RefCounted&) = delete;
+
+  void AddRef() const {
+    if constexpr (kMode == RefCountMode::kAtomic) {
+      ref_count_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      ++ref_count_;
+    }
+  }
+
+  void Release() const {
+    if constexpr (kMode == RefCountMode::kAtomic) {
+      // Orders every use of the object before its destruction.
+      if (ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete static_cast<const T*>(this);
+      }
+    } else if (--ref_count_ == 0) {
+      delete static_cast<const T*>(this);
+    }
+  }
+
+ protected:
+  RefCounted() = default;
+  ~RefCounted() = default;
+
+ private:
+  using Count = std::conditional_t<kMode == RefCountMode::kAtomic,
+                                   std::atomic<int32_t>, int32_t>;
+
+  mutable Count ref_count_{0};
+};
+
+// A reference to a |RefCounted| object. Copying increments the count,
+// moving does not touch it.
+template <typename T>
+class RefPtr {
+ public:
+  RefPtr() = default;
+  RefPtr(std::nullptr_t) {}  // NOLINT(google-explicit-constructor)
+  explicit RefPtr(T* ptr) : ptr_(ptr) {
+    if (ptr_ != nullptr) {
+      ptr_->AddRef();
+    }
+  }
+
+  RefPtr(const RefPtr& other) : RefPtr(other.ptr_) {}
+  RefPtr(RefPtr&& other) noexcept : ptr_(std::exchange(other.ptr_, nullptr)) {}
+
+  // Upcasts, e.g. |RefPtr<Animal>| from |RefPtr<Dog>|.
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  RefPtr(const RefPtr<U>& other)  // NOLINT(google-explicit-constructor)
+      : RefPtr(other.get()) {}
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+  RefPtr(RefPtr<U>&& other) noexcept  // NOLINT(google-explicit-constructor)
+      : ptr_(std::exchange(other.ptr_, nullptr)) {}
+
+  ~RefPtr() {
+    if (ptr_ != nullptr) {
+      ptr_->Release();
+    }
+  }
+
+  RefPtr& operator=(RefPtr other) noexcept {
+    std::swap(ptr_, other.ptr_);
+    return *this;
+  }
+
+  T* get() const { return ptr_; }
+  T& operator*() const { return *ptr_; }
+  T* operator->() const { return ptr_; }
+  explicit operator bool() const { return ptr_ != nullptr; }
+
+ private:
+  template <typename U>
+  friend class RefPtr;
+  template <typename To, typename From>
+  friend RefPtr<To> static_ref_cast(RefPtr<From>&& from);
+
+  // Takes over a reference which is already counted.
+  struct AdoptTag {};
+  RefPtr(T* ptr, AdoptTag) : ptr_(ptr) {}
+
+  T* ptr_ = nullptr;
+};
+
+template <typename T, typename... Args>
+RefPtr<T> MakeRef(Args&&... args) {
+  return RefPtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// Like |std::static_pointer_cast|. The caller guarantees the type, e.g. with
+// |isa<To>()| from above. The rvalue overload moves the reference over
+// without touching the count.
+template <typename To, typename From>
+RefPtr<To> static_ref_cast(const RefPtr<From>& from) {
+  return RefPtr<To>(static_cast<To*>(from.get()));
+}
+
+template <typename To, typename From>
+RefPtr<To> static_ref_cast(RefPtr<From>&& from) {
+  return RefPtr<To>(static_cast<To*>(std::exchange(from.ptr_, nullptr)),
+                    typename RefPtr<To>::AdoptTag());
+}
+
+// Per-type pooled allocation: |new T| takes a block from a free list of the
+// calling thread, carved out of 64 KiB slabs, and |delete| puts it back.
+// Blocks are exactly |sizeof(T)| bytes, without the header malloc adds.
+//
+// A block goes to the free list of the thread which frees it, and slabs are
+// never given back to the system. Use it for types which are allocated by the
+// million again and again, on long-lived threads. Subclasses of |T| inherit
+// the operators, but fall back to the global ones.
+template <typename T>
+class Pooled {
+ public:
+  static void* operator new(size_t size) {
+    if (size != sizeof(T)) {
+      return ::operator new(size);
+    }
+    Block*& head = FreeList();
+    if (head == nullptr) {
+      head = NewSlab();
+    }
+    Block* block = head;
+    head = block->next;
+    return block;
+  }
+
+  static void operator delete(void* ptr, size_t size) {
+    if (size != sizeof(T)) {
+      ::operator delete(ptr, size);
+      return;
+    }
+    Block*& head = FreeList();
+    head = new (ptr) Block{head};
+  }
+
+ private:
+  static constexpr size_t kSlabSize = 64 << 10;
+
+  struct Block {
+    Block* next;
+  };
+
+  static Block*& FreeList() {
+    thread_local Block* head = nullptr;
+    return head;
+  }
+
+  // Returns the blocks of a new slab, linked together.
+  static Block* NewSlab() {
+    static_assert(sizeof(T) >= sizeof(Block) && alignof(T) >= alignof(Block));
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    char* slab = static_cast<char*>(::operator new(kSlabSize));
+    const size_t count = kSlabSize / sizeof(T);
+    Block* head = nullptr;
+    for (size_t i = count; i > 0; --i) {
+      head = new (slab + (i - 1) * sizeof(T)) Block{head};
+    }
+    return head;
+  }
+};
+// --8<-- [end:code]
@@ -0,0 +1,28 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// |Animal| and |Dog| from above, reference counted and pooled.
+class Animal : public RefCounted<Animal> {
+ public:
+  virtual ~Animal() = default;
+  // ...
+};
+
+class Dog : public Animal, public Pooled<Dog> {
+  // ...
+};
+
+RefPtr<Animal> MakeAnimal() { return MakeRef<Dog>(); }  // One allocation.
+
+RefPtr<Animal> animal_dog = MakeAnimal();
+RefPtr<Animal> another = animal_dog;  // Count: 2.
+
+// The count is not touched: the reference moves from |animal_dog| to |dog|.
+RefPtr<Dog> dog = static_ref_cast<Dog>(std::move(animal_dog));
+
+// Objects can hand out references to themselves, without
+// |std::enable_shared_from_this|.
+RefPtr<Dog> self(dog.get());
+// --8<-- [end:code]
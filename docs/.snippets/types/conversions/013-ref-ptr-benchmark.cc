@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// Counts the heap allocations. Not inlined: GCC would warn about |free()|
+// on memory from |new|.
+std::atomic<int64_t> allocation_count{0};
+
+ABSL_ATTRIBUTE_NOINLINE void* operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+ABSL_ATTRIBUTE_NOINLINE void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+ABSL_ATTRIBUTE_NOINLINE void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+// libstdc++ skips the atomic operations of |std::shared_ptr| as long as the
+// process has never started a thread, which a server always has.
+const bool started_a_thread = [] {
+  std::thread([] {}).join();
+  return true;
+}();
+
+// The same 16 byte |Dog| in every variant: a virtual table pointer plus the
+// kind, or the reference count.
+class PlainAnimal {
+ public:
+  virtual ~PlainAnimal() = default;
+
+ private:
+  int32_t kind_ = 0;
+};
+
+class PlainDog : public PlainAnimal {};
+
+template <RefCountMode kMode>
+class CountedAnimal : public RefCounted<CountedAnimal<kMode>, kMode> {
+ public:
+  virtual ~CountedAnimal() = default;
+};
+
+template <RefCountMode kMode>
+class CountedDog : public CountedAnimal<kMode>,
+                   public Pooled<CountedDog<kMode>> {};
+
+using AtomicAnimal = CountedAnimal<RefCountMode::kAtomic>;
+using AtomicDog = CountedDog<RefCountMode::kAtomic>;
+using LocalAnimal = CountedAnimal<RefCountMode::kNonAtomic>;
+using LocalDog = CountedDog<RefCountMode::kNonAtomic>;
+
+// Creates |n| objects, then destroys them. Reports the allocations and the
+// heap bytes, malloc headers included, of the first round in the process:
+// later rounds of the pooled types reuse the slabs.
+template <typename Ptr, typename Make>
+void CreateAndDestroy(benchmark::State& state, Make make) {
+  static int64_t allocations = -1;
+  static int64_t bytes = 0;
+  const int64_t n = state.range(0);
+  std::vector<Ptr> objects;
+  objects.reserve(n);
+  for (auto _ : state) {
+    const int64_t allocations_before = allocation_count.load();
+    const size_t bytes_before = mallinfo2().uordblks;
+    for (int64_t i = 0; i < n; ++i) {
+      objects.push_back(make());
+    }
+    if (allocations < 0) {
+      allocations = allocation_count.load() - allocations_before;
+      bytes = mallinfo2().uordblks - bytes_before;
+    }
+    objects.clear();
+  }
+  state.counters["allocs_per_object"] = static_cast<double>(allocations) / n;
+  state.counters["bytes_per_object"] = static_cast<double>(bytes) / n;
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// As in conversions/003: the control block is allocated separately.
+void BM_CreateSharedFromUnique(benchmark::State& state) {
+  CreateAndDestroy<std::shared_ptr<PlainAnimal>>(state, [] {
+    std::unique_ptr<PlainAnimal> animal = std::make_unique<PlainDog>();
+    return std::shared_ptr<PlainAnimal>(std::move(animal));
+  });
+}
+BENCHMARK(BM_CreateSharedFromUnique)->Arg(1 << 20);
+
+void BM_CreateMakeShared(benchmark::State& state) {
+  CreateAndDestroy<std::shared_ptr<PlainAnimal>>(
+      state, [] { return std::make_shared<PlainDog>(); });
+}
+BENCHMARK(BM_CreateMakeShared)->Arg(1 << 20);
+
+void BM_CreateRefPtr(benchmark::State& state) {
+  CreateAndDestroy<RefPtr<AtomicAnimal>>(state,
+                                         [] { return MakeRef<AtomicDog>(); });
+}
+BENCHMARK(BM_CreateRefPtr)->Arg(1 << 20);
+
+void BM_CreateNonAtomicRefPtr(benchmark::State& state) {
+  CreateAndDestroy<RefPtr<LocalAnimal>>(state,
+                                        [] { return MakeRef<LocalDog>(); });
+}
+BENCHMARK(BM_CreateNonAtomicRefPtr)->Arg(1 << 20);
+
+// Copies a reference and destroys the copy: one increment, one decrement.
+template <typename Ptr>
+void CopyAndDestroy(benchmark::State& state, const Ptr& animal) {
+  for (auto _ : state) {
+    Ptr copy = animal;
+    benchmark::DoNotOptimize(copy);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_CopySharedPtr(benchmark::State& state) {
+  CopyAndDestroy(state, std::shared_ptr<PlainAnimal>(new PlainDog));
+}
+BENCHMARK(BM_CopySharedPtr);
+
+void BM_CopyRefPtr(benchmark::State& state) {
+  CopyAndDestroy(state, RefPtr<AtomicAnimal>(MakeRef<AtomicDog>()));
+}
+BENCHMARK(BM_CopyRefPtr);
+
+void BM_CopyNonAtomicRefPtr(benchmark::State& state) {
+  CopyAndDestroy(state, RefPtr<LocalAnimal>(MakeRef<LocalDog>()));
+}
+BENCHMARK(BM_CopyNonAtomicRefPtr);
+// --8<-- [end:code]
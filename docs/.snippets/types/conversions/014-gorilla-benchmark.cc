@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+constexpr int kSamples = 1 << 16;
+
+struct Samples {
+  std::vector<int64_t> timestamps_ms;
+  std::vector<double> values;
+};
+
+// A gauge scraped every 10 s, with a little jitter, whose value changes by a
+// few cents in one sample out of four. |noise| replaces the values with
+// random doubles, the worst case.
+Samples MakeSamples(bool noise) {
+  std::mt19937_64 gen(42);
+  std::normal_distribution<double> change(0, 1);
+  std::uniform_int_distribution<int64_t> jitter(-2, 2);
+  Samples samples;
+  int64_t timestamp_ms = 1'700'000'000'000;
+  double value = 42.0;
+  for (int i = 0; i < kSamples; ++i) {
+    timestamp_ms += 10'000 + (i % 8 == 0 ? jitter(gen) : 0);
+    if (noise) {
+      value = change(gen) * 1e9;
+    } else if (gen() % 4 == 0) {
+      value += std::round(change(gen) * 100) / 100;
+    }
+    samples.timestamps_ms.push_back(timestamp_ms);
+    samples.values.push_back(value);
+  }
+  return samples;
+}
+
+TimeSeriesChunkEncoder Encode(const Samples& samples) {
+  TimeSeriesChunkEncoder encoder;
+  for (int i = 0; i < kSamples; ++i) {
+    encoder.Append(samples.timestamps_ms[i], samples.values[i]);
+  }
+  return encoder;
+}
+
+// The baseline: the raw arrays, 16 bytes per sample.
+void BM_EncodeRaw(benchmark::State& state) {
+  const Samples samples = MakeSamples(state.range(0));
+  for (auto _ : state) {
+    Samples copy;
+    copy.timestamps_ms.reserve(kSamples);
+    copy.values.reserve(kSamples);
+    for (int i = 0; i < kSamples; ++i) {
+      copy.timestamps_ms.push_back(samples.timestamps_ms[i]);
+      copy.values.push_back(samples.values[i]);
+    }
+    benchmark::DoNotOptimize(copy);
+  }
+  state.SetBytesProcessed(state.iterations() * kSamples * 16);
+}
+BENCHMARK(BM_EncodeRaw)->Arg(false)->Arg(true);
+
+void BM_EncodeGorilla(benchmark::State& state) {
+  const Samples samples = MakeSamples(state.range(0));
+  size_t encoded_bytes = 0;
+  for (auto _ : state) {
+    TimeSeriesChunkEncoder encoder = Encode(samples);
+    encoded_bytes = encoder.size_in_bytes();
+    benchmark::DoNotOptimize(encoder);
+  }
+  state.counters["ratio"] = 16.0 * kSamples / encoded_bytes;
+  state.SetBytesProcessed(state.iterations() * kSamples * 16);
+}
+BENCHMARK(BM_EncodeGorilla)->Arg(false)->Arg(true);
+
+void BM_DecodeRaw(benchmark::State& state) {
+  const Samples samples = MakeSamples(state.range(0));
+  for (auto _ : state) {
+    int64_t timestamp_sum = 0;
+    double value_sum = 0;
+    for (int i = 0; i < kSamples; ++i) {
+      timestamp_sum += samples.timestamps_ms[i];
+      value_sum += samples.values[i];
+    }
+    benchmark::DoNotOptimize(timestamp_sum);
+    benchmark::DoNotOptimize(value_sum);
+  }
+  state.SetBytesProcessed(state.iterations() * kSamples * 16);
+}
+BENCHMARK(BM_DecodeRaw)->Arg(false)->Arg(true);
+
+// Decodes in batches of 256 and sums the samples, like a query would.
+void BM_DecodeGorilla(benchmark::State& state) {
+  const TimeSeriesChunkEncoder encoder = Encode(MakeSamples(state.range(0)));
+  std::array<int64_t, 256> timestamps;
+  std::array<double, 256> values;
+  for (auto _ : state) {
+    TimeSeriesChunkDecoder decoder(encoder.data(), encoder.count());
+    int64_t timestamp_sum = 0;
+    double value_sum = 0;
+    while (size_t n = decoder.Decode(absl::MakeSpan(timestamps),
+                                     absl::MakeSpan(values))) {
+      for (size_t i = 0; i < n; ++i) {
+        timestamp_sum += timestamps[i];
+        value_sum += values[i];
+      }
+    }
+    benchmark::DoNotOptimize(timestamp_sum);
+    benchmark::DoNotOptimize(value_sum);
+  }
+  state.SetBytesProcessed(state.iterations() * kSamples * 16);
+}
+BENCHMARK(BM_DecodeGorilla)->Arg(false)->Arg(true);
+// --8<-- [end:code]
@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// A chain of |kDepth| classes, each deriving from the one before, with the
+// kind being the depth of the most derived class. |Level<N>| is then every
+// object whose kind is at least |N|.
+class LevelBase {
+ public:
+  virtual ~LevelBase() = default;
+
+  int kind() const { return kind_; }
+
+ protected:
+  explicit LevelBase(int kind) : kind_(kind) {}
+
+ private:
+  const int kind_;
+};
+
+template <int N>
+class Level : public Level<N - 1> {
+ public:
+  Level() : Level<N - 1>(N) {}
+
+  static bool classof(const LevelBase* b) { return b->kind() >= N; }
+
+ protected:
+  explicit Level(int kind) : Level<N - 1>(kind) {}
+};
+
+template <>
+class Level<0> : public LevelBase {
+ public:
+  Level() : LevelBase(0) {}
+
+  static bool classof(const LevelBase*) { return true; }
+
+ protected:
+  explicit Level(int kind) : LevelBase(kind) {}
+};
+
+template <int... kN>
+std::unique_ptr<LevelBase> MakeLevel(int depth,
+                                     std::integer_sequence<int, kN...>) {
+  std::unique_ptr<LevelBase> object;
+  ((depth == kN ? void(object = std::make_unique<Level<kN>>()) : void()), ...);
+  return object;
+}
+
+// Objects of random depths from 0 to |kDepth|.
+template <int kDepth>
+std::vector<std::unique_ptr<LevelBase>> RandomLevels() {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> depth(0, kDepth);
+  std::vector<std::unique_ptr<LevelBase>> objects(1024);
+  for (auto& object : objects) {
+    object =
+        MakeLevel(depth(gen), std::make_integer_sequence<int, kDepth + 1>());
+  }
+  return objects;
+}
+
+// Counts the objects which are at least half as deep as the chain. The target
+// class is not final, so |dynamic_cast| cannot compare the type with a single
+// type_info: it searches the bases of the object's type.
+template <int kDepth, typename Cast>
+void CountDowncasts(benchmark::State& state, Cast cast) {
+  const auto objects = RandomLevels<kDepth>();
+  for (auto _ : state) {
+    int count = 0;
+    for (const auto& object : objects) {
+      count += cast(object.get()) != nullptr;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * objects.size());
+}
+
+template <int kDepth>
+void BM_DynamicCast(benchmark::State& state) {
+  CountDowncasts<kDepth>(state, [](LevelBase* b) {
+    return dynamic_cast<Level<kDepth / 2>*>(b);
+  });
+}
+BENCHMARK(BM_DynamicCast<2>);
+BENCHMARK(BM_DynamicCast<8>);
+BENCHMARK(BM_DynamicCast<32>);
+
+template <int kDepth>
+void BM_DynCast(benchmark::State& state) {
+  CountDowncasts<kDepth>(
+      state, [](LevelBase* b) { return dyn_cast<Level<kDepth / 2>>(b); });
+}
+BENCHMARK(BM_DynCast<2>);
+BENCHMARK(BM_DynCast<8>);
+BENCHMARK(BM_DynCast<32>);
+// --8<-- [end:code]
@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// 64K doubles (512 KiB, in L2) which all fit in a |uint8_t|, so that every
+// mode converts the whole span and the plain cast is well defined.
+std::vector<double> RandomFeatures() {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> distrib(0, 255);
+  std::vector<double> features(1 << 16);
+  for (double& f : features) {
+    f = distrib(gen);
+  }
+  return features;
+}
+
+// Reports GB/s of input doubles.
+template <typename T, typename Convert>
+void ConvertFeatures(benchmark::State& state, Convert convert) {
+  const std::vector<double> src = RandomFeatures();
+  std::vector<T> dst(src.size());
+  for (auto _ : state) {
+    convert(absl::MakeConstSpan(src), absl::MakeSpan(dst));
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * src.size() * sizeof(double));
+}
+
+// The baseline: what |int i = d;| does, without any range handling.
+template <typename T>
+void BM_StaticCastLoop(benchmark::State& state) {
+  ConvertFeatures<T>(state, [](absl::Span<const double> src, absl::Span<T> dst) {
+    for (size_t i = 0; i < src.size(); ++i) {
+      dst[i] = static_cast<T>(src[i]);
+    }
+  });
+}
+BENCHMARK(BM_StaticCastLoop<int32_t>);
+BENCHMARK(BM_StaticCastLoop<uint8_t>);
+
+// |NarrowSpan()| without the AVX2 path.
+template <typename T>
+void BM_ScalarNarrow(benchmark::State& state) {
+  const auto mode = static_cast<NarrowMode>(state.range(0));
+  ConvertFeatures<T>(state, [mode](absl::Span<const double> src,
+                                   absl::Span<T> dst) {
+    for (size_t i = 0; i < src.size(); ++i) {
+      if (!internal::NarrowOne(src[i], mode, &dst[i])) {
+        break;
+      }
+    }
+  });
+}
+BENCHMARK(BM_ScalarNarrow<int32_t>)->DenseRange(0, 2);
+BENCHMARK(BM_ScalarNarrow<uint8_t>)->DenseRange(0, 2);
+
+template <typename T>
+void BM_NarrowSpan(benchmark::State& state) {
+  const auto mode = static_cast<NarrowMode>(state.range(0));
+  ConvertFeatures<T>(state,
+                     [mode](absl::Span<const double> src, absl::Span<T> dst) {
+                       NarrowSpan(src, dst, mode);
+                     });
+}
+BENCHMARK(BM_NarrowSpan<int32_t>)->DenseRange(0, 2);
+BENCHMARK(BM_NarrowSpan<uint8_t>)->DenseRange(0, 2);
+// --8<-- [end:code]
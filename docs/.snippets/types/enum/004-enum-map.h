@@ -0,0 +1,177 @@
+/*
+ * SPDX-FileCopyrightText: 2021 Shuai Zhang
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// --8<-- [start:code]
+// Declares a scoped enum together with its names, at namespace scope:
+//
+//   #define FRUIT_VALUES(VALUE) VALUE(kUnspecified) VALUE(kApple)
+//   DEFINE_ENUM(FruitNew, uint8_t, FRUIT_VALUES)  // No trailing semicolon.
+//
+// The enumerators take the values 0, 1, 2, ... in the order of declaration,
+// which |EnumMap| and |EnumSet| use as indexes. Do not reorder or remove
+// enumerators which are stored or sent anywhere.
+#define ENUM_VALUE_(name) name,
+#define ENUM_NAME_(name) #name,
+#define DEFINE_ENUM(Enum, Underlying, VALUES)                            \
+  enum class Enum : Underlying { VALUES(ENUM_VALUE_) };                  \
+  /* Found by argument-dependent lookup, from any namespace. */          \
+  constexpr auto GetEnumNames(Enum) {                                    \
+    constexpr absl::string_view kNames[] = {VALUES(ENUM_NAME_)};         \
+    return ::enum_internal::ToArray(kNames);                             \
+  }
+
+namespace enum_internal {
+
+template <size_t N>
+constexpr std::array<absl::string_view, N> ToArray(
+    const absl::string_view (&names)[N]) {
+  std::array<absl::string_view, N> array{};
+  for (size_t i = 0; i < N; ++i) {
+    array[i] = names[i];
+  }
+  return array;
+}
+
+// Indexed by value, built once at compile time.
+template <typename E>
+inline constexpr auto kNames = GetEnumNames(E{});
+
+}  // namespace enum_internal
+
+template <typename E>
+constexpr size_t EnumSize() {
+  return enum_internal::kNames<E>.size();
+}
+
+template <typename E>
+constexpr size_t EnumIndex(E value) {
+  return static_cast<std::make_unsigned_t<std::underlying_type_t<E>>>(value);
+}
+
+// Returns "" for a value which is not an enumerator.
+template <typename E>
+constexpr absl::string_view EnumName(E value) {
+  const size_t index = EnumIndex(value);
+  return index < EnumSize<E>() ? enum_internal::kNames<E>[index]
+                               : absl::string_view();
+}
+
+// The inverse of |EnumName()|. A linear scan: comparing the sizes first
+// rules out most names without touching their bytes, and it is faster than a
+// binary search or a hash up to a few dozen enumerators.
+template <typename E>
+constexpr std::optional<E> ParseEnum(absl::string_view name) {
+  for (size_t i = 0; i < EnumSize<E>(); ++i) {
+    if (enum_internal::kNames<E>[i] == name) {
+      return static_cast<E>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+// A value for every enumerator, in an array indexed by the enumerator: no
+// hashing, no allocation, and the values of small enums share a cache line.
+// Values start value-initialized, use |std::optional<V>| or an |EnumSet| for
+// keys which may be absent.
+template <typename E, typename V>
+class EnumMap {
+ public:
+  constexpr EnumMap() = default;
+  constexpr EnumMap(std::initializer_list<std::pair<E, V>> entries) {
+    for (const auto& [key, value] : entries) {
+      (*this)[key] = value;
+    }
+  }
+
+  constexpr V& operator[](E key) {
+    assert(EnumIndex(key) < EnumSize<E>());
+    return values_[EnumIndex(key)];
+  }
+  constexpr const V& operator[](E key) const {
+    assert(EnumIndex(key) < EnumSize<E>());
+    return values_[EnumIndex(key)];
+  }
+
+  static constexpr size_t size() { return EnumSize<E>(); }
+
+  // Calls |f(key, value)| for every enumerator, in the order of declaration.
+  template <typename F>
+  constexpr void ForEach(F f) const {
+    for (size_t i = 0; i < size(); ++i) {
+      f(static_cast<E>(i), values_[i]);
+    }
+  }
+
+ private:
+  std::array<V, EnumSize<E>()> values_{};
+};
+
+// A set of enumerators, one bit each.
+template <typename E>
+class EnumSet {
+ public:
+  constexpr EnumSet() = default;
+  constexpr EnumSet(std::initializer_list<E> values) {
+    for (E value : values) {
+      insert(value);
+    }
+  }
+
+  constexpr void insert(E value) { word(value) |= bit(value); }
+  constexpr void erase(E value) { word(value) &= ~bit(value); }
+  // False for a value which is not an enumerator, e.g. one read from the wire.
+  constexpr bool contains(E value) const {
+    return EnumIndex(value) < EnumSize<E>() &&
+           (words_[EnumIndex(value) / 64] & bit(value)) != 0;
+  }
+
+  constexpr size_t size() const {
+    size_t count = 0;
+    for (uint64_t w : words_) {
+      count += absl::popcount(w);
+    }
+    return count;
+  }
+  constexpr bool empty() const { return size() == 0; }
+
+  // Calls |f(value)| for every member, in the order of declaration.
+  template <typename F>
+  constexpr void ForEach(F f) const {
+    for (size_t i = 0; i < words_.size(); ++i) {
+      for (uint64_t w = words_[i]; w != 0; w &= w - 1) {
+        f(static_cast<E>(i * 64 + absl::countr_zero(w)));
+      }
+    }
+  }
+
+  friend constexpr EnumSet operator|(EnumSet a, const EnumSet& b) {
+    for (size_t i = 0; i < a.words_.size(); ++i) {
+      a.words_[i] |= b.words_[i];
+    }
+    return a;
+  }
+  friend constexpr EnumSet operator&(EnumSet a, const EnumSet& b) {
+    for (size_t i = 0; i < a.words_.size(); ++i) {
+      a.words_[i] &= b.words_[i];
+    }
+    return a;
+  }
+  friend constexpr bool operator==(const EnumSet& a, const EnumSet& b) {
+    return a.words_ == b.words_;
+  }
+
+ private:
+  static constexpr uint64_t bit(E value) {
+    return uint64_t{1} << (EnumIndex(value) % 64);
+  }
+  constexpr uint64_t& word(E value) {
+    assert(EnumIndex(value) < EnumSize<E>());
+    return words_[EnumIndex(value) / 64];
+  }
+
+  std::array<uint64_t, (EnumSize<E>() + 63) / 64> words_{};
+};
+// --8<-- [end:code]
@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+#define FRUIT_VALUES(VALUE) \
+  VALUE(kUnspecified)       \
+  VALUE(kApple)             \
+  VALUE(kBanana)            \
+  VALUE(kCherry)
+DEFINE_ENUM(FruitNew, uint8_t, FRUIT_VALUES)
+
+static_assert(EnumName(FruitNew::kApple) == "kApple");
+static_assert(ParseEnum<FruitNew>("kCherry") == FruitNew::kCherry);
+static_assert(!ParseEnum<FruitNew>("kDurian").has_value());
+
+// Instead of std::unordered_map<FruitNew, int64_t>.
+EnumMap<FruitNew, int64_t> stock;
+stock[FruitNew::kApple] += 10;
+
+// Tables can be built at compile time.
+constexpr EnumMap<FruitNew, double> kPricePerKg = {
+    {FruitNew::kApple, 2.5},
+    {FruitNew::kBanana, 1.2},
+    {FruitNew::kCherry, 12.0},
+};
+static_assert(kPricePerKg[FruitNew::kCherry] == 12.0);
+
+constexpr EnumSet<FruitNew> kSeasonal = {FruitNew::kCherry};
+EnumSet<FruitNew> in_stock = {FruitNew::kApple, FruitNew::kCherry};
+(in_stock & kSeasonal).ForEach([](FruitNew fruit) {
+  std::cout << EnumName(fruit) << " is in season" << std::endl;
+});
+// --8<-- [end:code]
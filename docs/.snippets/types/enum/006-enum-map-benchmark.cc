@@ -0,0 +1,135 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// |FruitNew| from above, with a random enumerator per lookup.
+std::vector<FruitNew> RandomFruits() {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> index(0, EnumSize<FruitNew>() - 1);
+  std::vector<FruitNew> fruits(4096);
+  for (FruitNew& f : fruits) {
+    f = static_cast<FruitNew>(index(gen));
+  }
+  return fruits;
+}
+
+// Counts the heap bytes, malloc headers included. Not inlined: GCC would warn
+// about |free()| on memory from |new|.
+std::atomic<int64_t> heap_bytes{0};
+
+ABSL_ATTRIBUTE_NOINLINE void* operator new(size_t size) {
+  if (void* ptr = std::malloc(size)) {
+    heap_bytes.fetch_add(malloc_usable_size(ptr) + sizeof(size_t),
+                         std::memory_order_relaxed);
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+ABSL_ATTRIBUTE_NOINLINE void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr) {
+    heap_bytes.fetch_sub(malloc_usable_size(ptr) + sizeof(size_t),
+                         std::memory_order_relaxed);
+  }
+  std::free(ptr);
+}
+ABSL_ATTRIBUTE_NOINLINE void operator delete(void* ptr, size_t) noexcept {
+  ::operator delete(ptr);
+}
+
+// The bytes of the map, including its heap allocations.
+template <typename Map, typename Fill>
+int64_t Footprint(Map* map, Fill fill) {
+  const int64_t heap_before = heap_bytes.load();
+  fill(map);
+  return sizeof(*map) + heap_bytes.load() - heap_before;
+}
+
+template <typename Lookup>
+void LookUpFruits(benchmark::State& state, int64_t bytes, Lookup lookup) {
+  const std::vector<FruitNew> fruits = RandomFruits();
+  size_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lookup(fruits[next++ % fruits.size()]));
+  }
+  state.counters["bytes"] = bytes;
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_UnorderedMapLookup(benchmark::State& state) {
+  std::unordered_map<FruitNew, int64_t> stock;
+  const int64_t bytes = Footprint(&stock, [](auto* map) {
+    for (size_t i = 0; i < EnumSize<FruitNew>(); ++i) {
+      (*map)[static_cast<FruitNew>(i)] = i;
+    }
+  });
+  LookUpFruits(state, bytes,
+               [&](FruitNew f) { return stock.find(f)->second; });
+}
+BENCHMARK(BM_UnorderedMapLookup);
+
+void BM_EnumMapLookup(benchmark::State& state) {
+  EnumMap<FruitNew, int64_t> stock;
+  const int64_t bytes = Footprint(&stock, [](auto* map) {
+    for (size_t i = 0; i < EnumSize<FruitNew>(); ++i) {
+      (*map)[static_cast<FruitNew>(i)] = i;
+    }
+  });
+  LookUpFruits(state, bytes, [&](FruitNew f) { return stock[f]; });
+}
+BENCHMARK(BM_EnumMapLookup);
+
+void BM_UnorderedMapName(benchmark::State& state) {
+  std::unordered_map<FruitNew, std::string> names;
+  const int64_t bytes = Footprint(&names, [](auto* map) {
+    for (size_t i = 0; i < EnumSize<FruitNew>(); ++i) {
+      const auto fruit = static_cast<FruitNew>(i);
+      (*map)[fruit] = std::string(EnumName(fruit));
+    }
+  });
+  LookUpFruits(state, bytes, [&](FruitNew f) {
+    return absl::string_view(names.find(f)->second);
+  });
+}
+BENCHMARK(BM_UnorderedMapName);
+
+void BM_EnumName(benchmark::State& state) {
+  LookUpFruits(state, 0, [](FruitNew f) { return EnumName(f); });
+}
+BENCHMARK(BM_EnumName);
+
+// Parses the names of random enumerators. The string map needs a
+// |std::string| key: it has no lookup by |absl::string_view|. The names fit
+// in the small string buffer, so the key does not allocate.
+template <typename Parse>
+void ParseFruits(benchmark::State& state, Parse parse) {
+  std::vector<absl::string_view> names;
+  for (FruitNew f : RandomFruits()) {
+    names.push_back(EnumName(f));
+  }
+  size_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(parse(names[next++ % names.size()]));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_UnorderedMapParse(benchmark::State& state) {
+  std::unordered_map<std::string, FruitNew> by_name;
+  for (size_t i = 0; i < EnumSize<FruitNew>(); ++i) {
+    const auto fruit = static_cast<FruitNew>(i);
+    by_name[std::string(EnumName(fruit))] = fruit;
+  }
+  ParseFruits(state, [&](absl::string_view name) {
+    return by_name.find(std::string(name))->second;
+  });
+}
+BENCHMARK(BM_UnorderedMapParse);
+
+void BM_ParseEnum(benchmark::State& state) {
+  ParseFruits(state, [](absl::string_view name) {
+    return *ParseEnum<FruitNew>(name);
+  });
+}
+BENCHMARK(BM_ParseEnum);
+// --8<-- [end:code]
@@ -0,0 +1,100 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// The virtual interface, kept for existing callers. |AddAll()| lets them pay
+// one virtual call per batch instead of one per element.
+template <typename T>
+class List {
+ public:
+  virtual ~List() = default;
+
+  virtual void Add(T element) = 0;
+  virtual void AddAll(absl::Span<const T> elements) {
+    for (const T& element : elements) {
+      Add(element);
+    }
+  }
+};
+
+// The same contract as a C++20 concept, checked at compile time instead of
+// dispatched at run time.
+template <typename L, typename T>
+concept ListOf = requires(L& list, T element, absl::Span<const T> elements) {
+  list.Add(std::move(element));
+  list.AddAll(elements);
+  { list.begin() } -> std::random_access_iterator;
+  { list.end() } -> std::random_access_iterator;
+};
+
+// A contiguous list without any virtual function.
+template <typename T>
+class ArrayList final {
+ public:
+  using value_type = T;
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  void Add(T element) { elements_.push_back(std::move(element)); }
+  void AddAll(absl::Span<const T> elements) {
+    elements_.insert(elements_.end(), elements.begin(), elements.end());
+  }
+  void Reserve(size_t n) { elements_.reserve(n); }
+
+  size_t size() const { return elements_.size(); }
+  T& operator[](size_t i) { return elements_[i]; }
+  const T& operator[](size_t i) const { return elements_[i]; }
+
+  iterator begin() { return elements_.begin(); }
+  iterator end() { return elements_.end(); }
+  const_iterator begin() const { return elements_.begin(); }
+  const_iterator end() const { return elements_.end(); }
+
+ private:
+  std::vector<T> elements_;
+};
+
+static_assert(ListOf<ArrayList<int>, int>);
+
+// Adapts any |ListOf<T>| implementation to the virtual |List<T>| interface.
+// The class is |final|, so calls made through a |ListAdapter&| (rather than
+// a |List<T>&|) are devirtualized by the compiler.
+template <typename T, ListOf<T> L>
+class ListAdapter final : public List<T> {
+ public:
+  explicit ListAdapter(L list = L()) : list_(std::move(list)) {}
+
+  void Add(T element) override { list_.Add(std::move(element)); }
+  void AddAll(absl::Span<const T> elements) override {
+    list_.AddAll(elements);
+  }
+
+  L& list() { return list_; }
+  const L& list() const { return list_; }
+
+ private:
+  L list_;
+};
+
+// New code: take the concrete type as a template parameter, every call is
+// direct and inlinable.
+template <ListOf<int64_t> L>
+void AppendSquares(int64_t n, L& out) {
+  for (int64_t i = 0; i < n; ++i) {
+    out.Add(i * i);
+  }
+}
+
+// Existing code keeps working unchanged against the virtual interface.
+void AppendSquares(int64_t n, List<int64_t>& out);
+
+// Example:
+//   ArrayList<int64_t> squares;
+//   squares.Reserve(n);
+//   AppendSquares(n, squares);  // Static dispatch.
+//
+//   ListAdapter<int64_t, ArrayList<int64_t>> adapter;
+//   AppendSquares(n, static_cast<List<int64_t>&>(adapter));  // Virtual.
+//   std::sort(adapter.list().begin(), adapter.list().end());
+// --8<-- [end:code]
@@ -0,0 +1,101 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+int64_t MinorPageFaults() {
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt;
+}
+
+// The baseline is what the |FixedArray| from above does: a zero-filled
+// |std::unique_ptr<float[]>|, on pages of 4 KiB.
+struct UniquePtrArray {
+  explicit UniquePtrArray(size_t n)
+      : data(std::make_unique<float[]>(n)), size(n) {}
+  std::unique_ptr<float[]> data;
+  size_t size;
+};
+
+// Arrays of 1 KiB, 1 MiB, 64 MiB and 1 GiB of floats.
+void ArraySizes(benchmark::internal::Benchmark* b) {
+  for (int64_t bytes : {int64_t{1} << 10, int64_t{1} << 20, int64_t{64} << 20,
+                        int64_t{1} << 30}) {
+    b->Arg(bytes / sizeof(float));
+  }
+}
+
+// Allocates the array, writes every element once, then frees it: the cost of
+// a temporary buffer, page faults included.
+template <typename MakeAndFill>
+void AllocateAndFill(benchmark::State& state, MakeAndFill make_and_fill) {
+  const size_t n = state.range(0);
+  const int64_t faults_before = MinorPageFaults();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(make_and_fill(n));
+  }
+  state.counters["page_faults"] =
+      static_cast<double>(MinorPageFaults() - faults_before) /
+      state.iterations();
+  state.SetBytesProcessed(state.iterations() * n * sizeof(float));
+}
+
+void BM_AllocateUniquePtr(benchmark::State& state) {
+  AllocateAndFill(state, [](size_t n) {
+    UniquePtrArray array(n);
+    for (size_t i = 0; i < n; ++i) {
+      array.data[i] = i;
+    }
+    return array.data[n - 1];
+  });
+}
+BENCHMARK(BM_AllocateUniquePtr)->Apply(ArraySizes);
+
+void BM_AllocateFixedArray(benchmark::State& state) {
+  AllocateAndFill(state, [](size_t n) {
+    FixedArray<float, 0, 64> array;
+    array.resize_uninitialized(n);
+    for (size_t i = 0; i < n; ++i) {
+      array[i] = i;
+    }
+    return array[n - 1];
+  });
+}
+BENCHMARK(BM_AllocateFixedArray)->Apply(ArraySizes);
+
+// Reads random elements of a filled array: once the array is much larger
+// than the TLB covers, most reads also miss the TLB.
+template <typename Array>
+void ReadRandomElements(benchmark::State& state, const Array& array,
+                        size_t n) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> index(0, n - 1);
+  std::vector<size_t> indexes(1 << 16);
+  for (size_t& i : indexes) {
+    i = index(gen);
+  }
+  for (auto _ : state) {
+    float sum = 0;
+    for (size_t i : indexes) {
+      sum += array[i];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * indexes.size());
+}
+
+void BM_RandomReadUniquePtr(benchmark::State& state) {
+  const size_t n = state.range(0);
+  UniquePtrArray array(n);
+  ReadRandomElements(state, array.data, n);
+}
+BENCHMARK(BM_RandomReadUniquePtr)->Apply(ArraySizes);
+
+void BM_RandomReadFixedArray(benchmark::State& state) {
+  const size_t n = state.range(0);
+  FixedArray<float, 0, 64> array(n);
+  ReadRandomElements(state, array, n);
+}
+BENCHMARK(BM_RandomReadFixedArray)->Apply(ArraySizes);
+// --8<-- [end:code]
@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// A second implementation, as a real program has: with only one, GCC guesses
+// the target of |List<int64_t>::Add()| and inlines it behind a check
+// (speculative devirtualization), which hides the cost of the virtual call.
+class DiscardingList final : public List<int64_t> {
+ public:
+  void Add(int64_t) override {}
+};
+DiscardingList discarding_list;
+
+// Existing code, compiled without knowing the concrete list: one virtual call
+// per element. Not inlined, as if it lived in another translation unit.
+ABSL_ATTRIBUTE_NOINLINE void AppendSquares(int64_t n, List<int64_t>& out) {
+  for (int64_t i = 0; i < n; ++i) {
+    out.Add(i * i);
+  }
+}
+
+// The same, one virtual call per batch of 256 elements.
+ABSL_ATTRIBUTE_NOINLINE void AppendSquaresInBatches(int64_t n,
+                                                    List<int64_t>& out) {
+  std::array<int64_t, 256> batch;
+  for (int64_t i = 0; i < n; i += batch.size()) {
+    const int64_t size = std::min<int64_t>(batch.size(), n - i);
+    for (int64_t j = 0; j < size; ++j) {
+      batch[j] = (i + j) * (i + j);
+    }
+    out.AddAll(absl::MakeConstSpan(batch.data(), size));
+  }
+}
+
+// Fills a list of 1M elements, reserved in advance, per iteration.
+constexpr int64_t kElements = 1 << 20;
+
+template <typename Fill>
+void FillList(benchmark::State& state, Fill fill) {
+  for (auto _ : state) {
+    ListAdapter<int64_t, ArrayList<int64_t>> adapter;
+    adapter.list().Reserve(kElements);
+    fill(adapter);
+    benchmark::DoNotOptimize(adapter.list()[kElements - 1]);
+  }
+  state.SetItemsProcessed(state.iterations() * kElements);
+}
+
+void BM_AddVirtual(benchmark::State& state) {
+  FillList(state, [](auto& adapter) {
+    AppendSquares(kElements, static_cast<List<int64_t>&>(adapter));
+  });
+}
+BENCHMARK(BM_AddVirtual);
+
+void BM_AddAllVirtual(benchmark::State& state) {
+  FillList(state, [](auto& adapter) {
+    AppendSquaresInBatches(kElements, static_cast<List<int64_t>&>(adapter));
+  });
+}
+BENCHMARK(BM_AddAllVirtual);
+
+void BM_AddStatic(benchmark::State& state) {
+  FillList(state,
+           [](auto& adapter) { AppendSquares(kElements, adapter.list()); });
+}
+BENCHMARK(BM_AddStatic);
+// --8<-- [end:code]
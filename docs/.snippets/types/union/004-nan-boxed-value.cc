@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// A self-describing 8-byte value holding the same members as |UnionStorage|
+// plus a double, using NaN-boxing.
+//
+// An IEEE 754 double is a NaN whenever all 11 exponent bits are set, so most of
+// the 2^64 bit patterns are NaNs that real computations never produce. We
+// canonicalize every incoming NaN to |kCanonicalNaN| (sign bit clear), then use
+// the negative quiet-NaN space (top 13 bits set) for the other members:
+//
+//   63        51 50  48 47        32 31                    0
+//   +-----------+------+------------+-----------------------+
+//   | 1111...1  | tag  |  (unused)  |    32-bit payload     |
+//   +-----------+------+------------+-----------------------+
+//
+// Anything else is a plain double.
+class BoxedValue {
+ public:
+  enum class Type : uint8_t {
+    kUnspecified = 0,
+    kInt32 = 1,
+    kUint16Array = 2,
+    kUint8 = 3,
+    kDouble = 4,  // Not encoded in the tag bits; see the layout above.
+  };
+  static constexpr size_t kNumTypes = 5;
+
+  BoxedValue() : bits_(Box(Type::kUnspecified, 0)) {}
+  explicit BoxedValue(double d)
+      : bits_(std::isnan(d) ? kCanonicalNaN : absl::bit_cast<uint64_t>(d)) {}
+  explicit BoxedValue(int32_t n)
+      : bits_(Box(Type::kInt32, static_cast<uint32_t>(n))) {}
+  explicit BoxedValue(std::array<uint16_t, 2> s)
+      : bits_(Box(Type::kUint16Array, absl::bit_cast<uint32_t>(s))) {}
+  explicit BoxedValue(uint8_t c) : bits_(Box(Type::kUint8, c)) {}
+
+  Type type() const {
+    if ((bits_ & kBoxMask) != kBoxMask) {
+      return Type::kDouble;
+    }
+    return static_cast<Type>((bits_ >> kTagShift) & kTagMask);
+  }
+
+  // Precondition: type() matches the requested member. Checked in debug mode.
+  double AsDouble() const {
+    assert(type() == Type::kDouble);
+    return absl::bit_cast<double>(bits_);
+  }
+  int32_t AsInt32() const {
+    assert(type() == Type::kInt32);
+    return static_cast<int32_t>(payload());
+  }
+  std::array<uint16_t, 2> AsUint16Array() const {
+    assert(type() == Type::kUint16Array);
+    return absl::bit_cast<std::array<uint16_t, 2>>(payload());
+  }
+  uint8_t AsUint8() const {
+    assert(type() == Type::kUint8);
+    return static_cast<uint8_t>(payload());
+  }
+
+  // Calls |visitor| with the active member, or with |absl::monostate| for
+  // |kUnspecified|. The dispatch table is generated at compile time, so a
+  // visit is one indexed indirect call instead of a chain of branches.
+  //
+  // Example:
+  //   double sum = 0;
+  //   for (const BoxedValue& v : values) {
+  //     sum += v.Visit([](auto x) { return ToDouble(x); });
+  //   }
+  template <typename Visitor>
+  decltype(auto) Visit(Visitor&& visitor) const {
+    using R = std::invoke_result_t<Visitor&, double>;
+    static constexpr auto kTable =
+        MakeDispatchTable<Visitor, R>(std::make_index_sequence<kNumTypes>{});
+    return kTable[static_cast<size_t>(type())](visitor, *this);
+  }
+
+ private:
+  static constexpr uint64_t kCanonicalNaN = 0x7FF8'0000'0000'0000;
+  static constexpr uint64_t kBoxMask = 0xFFF8'0000'0000'0000;
+  static constexpr int kTagShift = 48;
+  static constexpr uint64_t kTagMask = 0x7;
+
+  static constexpr uint64_t Box(Type type, uint32_t payload) {
+    return kBoxMask | (static_cast<uint64_t>(type) << kTagShift) | payload;
+  }
+
+  uint32_t payload() const { return static_cast<uint32_t>(bits_); }
+
+  template <typename Visitor, typename R, size_t kType>
+  static R Dispatch(Visitor& visitor, const BoxedValue& v) {
+    constexpr Type type = static_cast<Type>(kType);
+    if constexpr (type == Type::kDouble) {
+      return visitor(v.AsDouble());
+    } else if constexpr (type == Type::kInt32) {
+      return visitor(v.AsInt32());
+    } else if constexpr (type == Type::kUint16Array) {
+      return visitor(v.AsUint16Array());
+    } else if constexpr (type == Type::kUint8) {
+      return visitor(v.AsUint8());
+    } else {
+      return visitor(absl::monostate{});
+    }
+  }
+
+  template <typename Visitor, typename R, size_t... kTypes>
+  static constexpr auto MakeDispatchTable(std::index_sequence<kTypes...>) {
+    using Fn = R (*)(Visitor&, const BoxedValue&);
+    return std::array<Fn, kNumTypes>{&Dispatch<Visitor, R, kTypes>...};
+  }
+
+  uint64_t bits_;
+};
+
+static_assert(sizeof(BoxedValue) == 8, "Must fit in one register");
+static_assert(std::is_trivially_copyable<BoxedValue>::value,
+              "Must be passed around like a double");
+// --8<-- [end:code]
@@ -0,0 +1,182 @@
+// SPDX-FileCopyrightText: 2021 Shuai Zhang
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// --8<-- [start:code]
+// The baselines hold the same members as |BoxedValue|: |UnionStorage| with a
+// |double| added to the union, and the equivalent |absl::variant|.
+struct TaggedValue {
+  BoxedValue::Type type;
+  union {
+    double d;
+    int32_t n;
+    uint16_t s[2];
+    uint8_t c;
+  } data;
+};
+
+using VariantValue = absl::variant<absl::monostate, double, int32_t,
+                                   std::array<uint16_t, 2>, uint8_t>;
+
+static_assert(sizeof(TaggedValue) == 16 && sizeof(VariantValue) == 16);
+
+struct ToDouble {
+  double operator()(absl::monostate) const { return 0; }
+  double operator()(double d) const { return d; }
+  double operator()(int32_t n) const { return n; }
+  double operator()(std::array<uint16_t, 2> s) const { return s[0] + s[1]; }
+  double operator()(uint8_t c) const { return c; }
+};
+
+double SumWithVisit(absl::Span<const BoxedValue> values) {
+  double sum = 0;
+  for (const BoxedValue& v : values) {
+    sum += v.Visit(ToDouble());
+  }
+  return sum;
+}
+
+// The same loop without |Visit()|: the compiler sees every case, instead of
+// an indirect call through the dispatch table.
+double SumWithSwitch(absl::Span<const BoxedValue> values) {
+  double sum = 0;
+  for (const BoxedValue& v : values) {
+    switch (v.type()) {
+      case BoxedValue::Type::kDouble:
+        sum += v.AsDouble();
+        break;
+      case BoxedValue::Type::kInt32:
+        sum += v.AsInt32();
+        break;
+      case BoxedValue::Type::kUint16Array:
+        sum += ToDouble()(v.AsUint16Array());
+        break;
+      case BoxedValue::Type::kUint8:
+        sum += v.AsUint8();
+        break;
+      case BoxedValue::Type::kUnspecified:
+        break;
+    }
+  }
+  return sum;
+}
+
+double SumTagged(absl::Span<const TaggedValue> values) {
+  double sum = 0;
+  for (const TaggedValue& v : values) {
+    switch (v.type) {
+      case BoxedValue::Type::kDouble:
+        sum += v.data.d;
+        break;
+      case BoxedValue::Type::kInt32:
+        sum += v.data.n;
+        break;
+      case BoxedValue::Type::kUint16Array:
+        sum += v.data.s[0] + v.data.s[1];
+        break;
+      case BoxedValue::Type::kUint8:
+        sum += v.data.c;
+        break;
+      case BoxedValue::Type::kUnspecified:
+        break;
+    }
+  }
+  return sum;
+}
+
+double SumVariant(absl::Span<const VariantValue> values) {
+  double sum = 0;
+  for (const VariantValue& v : values) {
+    sum += absl::visit(ToDouble(), v);
+  }
+  return sum;
+}
+
+BoxedValue MakeBoxed(double d) { return BoxedValue(d); }
+BoxedValue MakeBoxed(int32_t n) { return BoxedValue(n); }
+BoxedValue MakeBoxed(std::array<uint16_t, 2> s) { return BoxedValue(s); }
+BoxedValue MakeBoxed(uint8_t c) { return BoxedValue(c); }
+
+TaggedValue MakeTagged(double d) {
+  TaggedValue v{BoxedValue::Type::kDouble, {}};
+  v.data.d = d;
+  return v;
+}
+TaggedValue MakeTagged(int32_t n) {
+  TaggedValue v{BoxedValue::Type::kInt32, {}};
+  v.data.n = n;
+  return v;
+}
+TaggedValue MakeTagged(std::array<uint16_t, 2> s) {
+  TaggedValue v{BoxedValue::Type::kUint16Array, {}};
+  v.data.s[0] = s[0];
+  v.data.s[1] = s[1];
+  return v;
+}
+TaggedValue MakeTagged(uint8_t c) {
+  TaggedValue v{BoxedValue::Type::kUint8, {}};
+  v.data.c = c;
+  return v;
+}
+
+// Mostly doubles, as in an interpreter running numeric code, with the other
+// members mixed in at random: the type is not predictable.
+template <typename Value, typename Make>
+std::vector<Value> RandomValues(int64_t n, Make make) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<> kind(0, 7);
+  std::vector<Value> values;
+  values.reserve(n);
+  for (int64_t i = 0; i < n; ++i) {
+    switch (kind(gen)) {
+      case 0:
+        values.push_back(make(static_cast<int32_t>(i)));
+        break;
+      case 1:
+        values.push_back(make(static_cast<uint8_t>(i)));
+        break;
+      case 2:
+        values.push_back(make(std::array<uint16_t, 2>{1, 2}));
+        break;
+      default:
+        values.push_back(make(i * 0.5));
+    }
+  }
+  return values;
+}
+
+// 4 KiB or 8 KiB of values, which fit in L1, then 32 MiB or 64 MiB.
+template <typename Value, typename Make, typename Sum>
+void SumValues(benchmark::State& state, Make make, Sum sum) {
+  const std::vector<Value> values = RandomValues<Value>(state.range(0), make);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sum(values));
+  }
+  state.counters["bytes_per_value"] = sizeof(Value);
+  state.SetItemsProcessed(state.iterations() * values.size());
+}
+
+void BM_SumBoxedWithVisit(benchmark::State& state) {
+  SumValues<BoxedValue>(
+      state, [](auto x) { return MakeBoxed(x); }, &SumWithVisit);
+}
+BENCHMARK(BM_SumBoxedWithVisit)->Arg(1 << 10)->Arg(1 << 22);
+
+void BM_SumBoxedWithSwitch(benchmark::State& state) {
+  SumValues<BoxedValue>(
+      state, [](auto x) { return MakeBoxed(x); }, &SumWithSwitch);
+}
+BENCHMARK(BM_SumBoxedWithSwitch)->Arg(1 << 10)->Arg(1 << 22);
+
+void BM_SumTagged(benchmark::State& state) {
+  SumValues<TaggedValue>(
+      state, [](auto x) { return MakeTagged(x); }, &SumTagged);
+}
+BENCHMARK(BM_SumTagged)->Arg(1 << 10)->Arg(1 << 22);
+
+void BM_SumVariant(benchmark::State& state) {
+  SumValues<VariantValue>(
+      state, [](auto x) { return VariantValue(x); }, &SumVariant);
+}
+BENCHMARK(BM_SumVariant)->Arg(1 << 10)->Arg(1 << 22);
+// --8<-- [end:code]